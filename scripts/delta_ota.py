@@ -0,0 +1,209 @@
+import hashlib
+import json
+import os
+import re
+import struct
+import urllib.request
+import uuid
+Import("env")
+
+""" Delta OTA upload
+
+Keeps a copy of the firmware last uploaded to each device. On upload the
+device is asked which firmware it is running (/firmware); if that matches the
+stored copy, only a binary delta is sent to /delta and applied on the device
+(see src/deltaHelper.h). Otherwise the normal espota upload of the full
+(gzipped) image runs instead.
+"""
+
+MIN_COPY = 16  # shorter matches are cheaper as literal data
+BLOCK = 8      # index granularity when searching the base image
+OP_END, OP_COPY, OP_DATA = 0, 1, 2
+
+
+def makeDelta(base, target):
+    """ Greedy block matching delta of target against base """
+    index = {}
+    for pos in range(0, len(base) - BLOCK + 1):
+        index.setdefault(base[pos:pos + BLOCK], pos)
+
+    ops = []
+    literal = bytearray()
+    expected = None  # where the previous copy would continue in base
+    pos = 0
+
+    def matchLength(basePos, targetPos):
+        length = 0
+        limit = min(len(base) - basePos, len(target) - targetPos)
+        while length < limit:
+            step = min(64, limit - length)
+            if base[basePos + length:basePos + length + step] == \
+                    target[targetPos + length:targetPos + length + step]:
+                length += step
+                continue
+            while base[basePos + length] == target[targetPos + length]:
+                length += 1
+            break
+        return length
+
+    while pos < len(target):
+        best, bestLen = None, 0
+        candidates = [expected] if expected is not None else []
+        candidates.append(index.get(target[pos:pos + BLOCK]))
+        for candidate in candidates:
+            if candidate is None or candidate >= len(base):
+                continue
+            length = matchLength(candidate, pos)
+            if length > bestLen:
+                best, bestLen = candidate, length
+
+        if bestLen >= MIN_COPY:
+            if literal:
+                ops.append((OP_DATA, bytes(literal)))
+                literal = bytearray()
+            ops.append((OP_COPY, best, bestLen))
+            pos += bestLen
+            expected = best + bestLen
+        else:
+            literal.append(target[pos])
+            pos += 1
+            if expected is not None:
+                expected += 1
+
+    if literal:
+        ops.append((OP_DATA, bytes(literal)))
+
+    patch = bytearray(b"NTPD")
+    patch += struct.pack("<BI", 1, len(base)) + hashlib.md5(base).digest()
+    patch += struct.pack("<I", len(target)) + hashlib.md5(target).digest()
+    for op in ops:
+        if op[0] == OP_COPY:
+            patch += struct.pack("<BII", OP_COPY, op[1], op[2])
+        else:
+            patch += struct.pack("<BI", OP_DATA, len(op[1])) + op[1]
+    patch.append(OP_END)
+    return bytes(patch)
+
+
+def applyDelta(base, patch):
+    """ Reference implementation of the on-device patcher, for verification """
+    pos = 45
+    out = bytearray()
+    while patch[pos] != OP_END:
+        if patch[pos] == OP_COPY:
+            offset, length = struct.unpack_from("<II", patch, pos + 1)
+            out += base[offset:offset + length]
+            pos += 9
+        else:
+            (length,) = struct.unpack_from("<I", patch, pos + 1)
+            out += patch[pos + 5:pos + 5 + length]
+            pos += 5 + length
+    return bytes(out)
+
+
+def firmwareVersion():
+    with open(os.path.join(env.subst("$PROJECT_SRC_DIR"), "globals.h")) as f:
+        match = re.search(r'#define VERSION "([^"]+)"', f.read())
+    return match.group(1) if match else "unknown"
+
+
+def deployedPaths(env):
+    folder = os.path.join(env.subst("$PROJECT_DIR"), "firmware",
+                          env.subst("$PIOENV"))
+    return os.path.join(folder, "deployed.bin"), \
+        os.path.join(folder, "deployed.json")
+
+
+def recordDeployed(env, image):
+    binPath, infoPath = deployedPaths(env)
+    os.makedirs(os.path.dirname(binPath), exist_ok=True)
+    with open(binPath, "wb") as f:
+        f.write(image)
+    with open(infoPath, "w") as f:
+        json.dump({"version": firmwareVersion(),
+                   "md5": hashlib.md5(image).hexdigest(),
+                   "size": len(image)}, f)
+
+
+def postPatch(url, patch):
+    boundary = uuid.uuid4().hex
+    body = ("--%s\r\nContent-Disposition: form-data; name=\"patch\"; "
+            "filename=\"firmware.delta\"\r\n"
+            "Content-Type: application/octet-stream\r\n\r\n" % boundary
+            ).encode() + patch + ("\r\n--%s--\r\n" % boundary).encode()
+    request = urllib.request.Request(url, data=body, method="POST")
+    request.add_header("Content-Type",
+                       "multipart/form-data; boundary=" + boundary)
+    with urllib.request.urlopen(request, timeout=120) as response:
+        return response.status, response.read().decode(errors="replace")
+
+
+def tryDelta(env, image):
+    """ Returns True if the device was updated with a delta patch """
+    binPath, infoPath = deployedPaths(env)
+    if not (os.path.exists(binPath) and os.path.exists(infoPath)):
+        print("Delta OTA: no deployed base recorded, sending full image")
+        return False
+
+    host = "http://" + env.subst("$UPLOAD_PORT")
+    try:
+        with urllib.request.urlopen(host + "/firmware", timeout=10) as r:
+            running = json.load(r)
+    except Exception as e:
+        print("Delta OTA: can't query device ({}), sending full image".format(e))
+        return False
+
+    with open(infoPath) as f:
+        deployed = json.load(f)
+    if running.get("md5") != deployed["md5"]:
+        print("Delta OTA: device runs {} ({}), not recorded base {} ({}), "
+              "sending full image".format(running.get("version"),
+                                          running.get("md5"),
+                                          deployed["version"],
+                                          deployed["md5"]))
+        return False
+
+    with open(binPath, "rb") as f:
+        base = f.read()
+    patch = makeDelta(base, image)
+    if applyDelta(base, patch) != image:
+        print("Delta OTA: patch self-check failed, sending full image")
+        return False
+    if len(patch) >= len(image) // 2:
+        print("Delta OTA: patch not worth it ({} bytes), sending full image"
+              .format(len(patch)))
+        return False
+
+    print("Delta OTA: {} {} -> {}, patch is {} bytes ({:.1f}% of image)"
+          .format(env.subst("$UPLOAD_PORT"), deployed["version"],
+                  firmwareVersion(), len(patch),
+                  100.0 * len(patch) / len(image)))
+    try:
+        status, text = postPatch(host + "/delta", patch)
+    except Exception as e:
+        print("Delta OTA: upload failed ({}), sending full image".format(e))
+        return False
+    print("Delta OTA: device replied {} {}".format(status, text))
+    return status == 200
+
+
+def deltaUpload(source, target, env):
+    firmware = env.subst("$BUILD_DIR") + os.sep + env.subst("$PROGNAME") + ".bin"
+    # compressed_ota.py keeps the uncompressed image as .bak
+    uncompressed = firmware + ".bak" if os.path.exists(firmware + ".bak") \
+        else firmware
+    with open(uncompressed, "rb") as f:
+        image = f.read()
+
+    if not tryDelta(env, image):
+        result = env.Execute(env.subst(fullUpload, source=source,
+                                       target=target))
+        if result:
+            return result
+
+    recordDeployed(env, image)
+    return 0
+
+
+fullUpload = env["UPLOADCMD"]
+env.Replace(UPLOADCMD=deltaUpload)
@@ -0,0 +1,214 @@
+#!/usr/bin/env python3
+""" HTTP load test for the clock's web server
+
+Runs one or more scenarios against a clock (or the native-loadtest stand-in,
+see test/loadtest/server.cpp) and reports requests/s, latency percentiles
+and the device's heap and loop timing figures from /stats, which is polled
+once a second during each run.
+
+  scripts/loadtest.py --host 127.0.0.1:8080            # all scenarios
+  scripts/loadtest.py --host ntp-clock.local poll slow  # some, on a device
+
+Scenarios:
+  poll   dashboards polling /getTimedate once a second (--clients of them)
+  info   back to back /info renders, --clients at once
+  slow   pollers as above, plus clients that trickle their request headers
+         a byte at a time; the server reads requests synchronously, so each
+         one stalls the loop
+  mixed  pollers, a back to back /info client and a slow client together
+"""
+
+import argparse
+import asyncio
+import json
+import time
+
+latencyBuckets = (50, 90, 99)
+
+
+class Results:
+    def __init__(self):
+        self.latencies = []  # seconds, successful requests
+        self.errors = 0
+        self.stats = []      # /stats samples
+
+    def summary(self, elapsed):
+        lat = sorted(self.latencies)
+
+        def pct(p):
+            return lat[min(len(lat) - 1, int(p / 100 * len(lat)))] * 1000 \
+                if lat else 0
+
+        out = {
+            "requests": len(lat),
+            "errors": self.errors,
+            "reqPerSec": len(lat) / elapsed,
+            "latencyMs": {"p%d" % p: pct(p) for p in latencyBuckets},
+        }
+        out["latencyMs"]["max"] = lat[-1] * 1000 if lat else 0
+        if self.stats:
+            out["heapLowWater"] = min(s["heapLowWater"] for s in self.stats)
+            out["minMaxFreeBlock"] = min(s["maxFreeBlock"] for s in self.stats)
+            out["maxFragmentation"] = max(s["heapFragmentation"]
+                                          for s in self.stats)
+            out["tickErrorMaxMs"] = max(s["tickErrorMax"] for s in self.stats)
+            out["loopGapMaxMs"] = max(s["loopGapMax"] for s in self.stats)
+        return out
+
+
+async def get(host, port, path, timeout, trickle=0):
+    """ GET path, returning the status code; trickle sends the request one
+    byte at a time with that many seconds between bytes """
+    reader, writer = await asyncio.wait_for(
+        asyncio.open_connection(host, port), timeout)
+    try:
+        request = ("GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n"
+                   % (path, host)).encode()
+        if trickle:
+            for i in range(len(request)):
+                writer.write(request[i:i + 1])
+                await writer.drain()
+                await asyncio.sleep(trickle)
+        else:
+            writer.write(request)
+            await writer.drain()
+        response = await asyncio.wait_for(reader.read(), timeout)
+    finally:
+        writer.close()
+    status = response.split(b" ", 2)
+    return int(status[1]) if len(status) > 1 else 0
+
+
+async def client(args, path, interval, results, stop, trickle=0):
+    while not stop.is_set():
+        start = time.monotonic()
+        try:
+            status = await get(args.host, args.port, path, args.timeout,
+                               trickle)
+            if status == 200:
+                results.latencies.append(time.monotonic() - start)
+            else:
+                results.errors += 1
+        except (OSError, asyncio.TimeoutError):
+            results.errors += 1
+        if interval:
+            await asyncio.sleep(max(0, interval - (time.monotonic() - start)))
+
+
+def scenario(name, args, results, stop):
+    # slow clients' own latency isn't of interest, only their effect
+    ignored = Results()
+
+    def pollers():
+        return [client(args, "/getTimedate", 1.0, results, stop)
+                for _ in range(args.clients)]
+
+    def slow(count):
+        return [client(args, "/getTimedate", 0, ignored, stop,
+                       trickle=args.trickle) for _ in range(count)]
+
+    if name == "poll":
+        return pollers()
+    if name == "info":
+        return [client(args, "/info", 0, results, stop)
+                for _ in range(args.clients)]
+    if name == "slow":
+        return pollers() + slow(args.slow_clients)
+    if name == "mixed":
+        return pollers() + [client(args, "/info", 0, results, stop)] + slow(1)
+    raise SystemExit("unknown scenario " + name)
+
+
+async def readStats(args):
+    reader, writer = await asyncio.wait_for(
+        asyncio.open_connection(args.host, args.port), args.timeout)
+    writer.write(b"GET /stats HTTP/1.1\r\nConnection: close\r\n\r\n")
+    response = await asyncio.wait_for(reader.read(), args.timeout)
+    writer.close()
+    return json.loads(response.split(b"\r\n\r\n", 1)[1])
+
+
+async def sampleStats(args, results):
+    try:
+        results.stats.append(await readStats(args))
+    except (OSError, asyncio.TimeoutError, ValueError, IndexError):
+        pass
+
+
+async def statsPoller(args, results, stop):
+    while not stop.is_set():
+        await sampleStats(args, results)
+        await asyncio.sleep(1)
+
+
+async def run(name, args):
+    results = Results()
+    stop = asyncio.Event()
+
+    await sampleStats(args, Results())  # resets the low water marks
+
+    tasks = [asyncio.ensure_future(c)
+             for c in scenario(name, args, results, stop)]
+    tasks.append(asyncio.ensure_future(statsPoller(args, results, stop)))
+    start = time.monotonic()
+    await stopAfter(stop, args.duration)
+    await asyncio.gather(*tasks)
+    elapsed = time.monotonic() - start
+
+    # covers anything the poller missed while the server was saturated
+    await sampleStats(args, results)
+    return results.summary(elapsed)
+
+
+async def stopAfter(stop, seconds):
+    await asyncio.sleep(seconds)
+    stop.set()
+
+
+def printSummary(name, s):
+    lat = s["latencyMs"]
+    print("%-6s %6d req %4d err %7.1f req/s  latency ms p50 %.0f p90 %.0f "
+          "p99 %.0f max %.0f" % (name, s["requests"], s["errors"],
+                                 s["reqPerSec"], lat["p50"], lat["p90"],
+                                 lat["p99"], lat["max"]))
+    if "heapLowWater" in s:
+        print("       heap low water %d, min largest block %d, "
+              "max fragmentation %d%%"
+              % (s["heapLowWater"], s["minMaxFreeBlock"],
+                 s["maxFragmentation"]))
+        print("       worst tick %d ms, longest loop gap %d ms"
+              % (s["tickErrorMaxMs"], s["loopGapMaxMs"]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    parser.add_argument("scenarios", nargs="*",
+                        default=["poll", "info", "slow", "mixed"])
+    parser.add_argument("--host", default="127.0.0.1:8080",
+                        help="clock address, host[:port]")
+    parser.add_argument("--duration", type=float, default=20,
+                        help="seconds per scenario")
+    parser.add_argument("--clients", type=int, default=8,
+                        help="pollers / concurrent /info clients")
+    parser.add_argument("--slow-clients", type=int, default=2)
+    parser.add_argument("--trickle", type=float, default=0.2,
+                        help="seconds between bytes from slow clients")
+    parser.add_argument("--timeout", type=float, default=10)
+    parser.add_argument("--json", help="also write the results here")
+    args = parser.parse_args()
+
+    host, _, port = args.host.partition(":")
+    args.host, args.port = host, int(port or 80)
+
+    summaries = {}
+    for name in args.scenarios:
+        summaries[name] = asyncio.run(run(name, args))
+        printSummary(name, summaries[name])
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(summaries, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()
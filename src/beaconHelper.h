@@ -0,0 +1,216 @@
+#pragma once
+
+#include <ESP8266WiFi.h>         // ESP8266 Core WiFi Library
+#include <globals.h>             // Global libraries and variables
+#include <include/UdpContext.h>  // lwIP UDP with a receive callback
+#include <lwip/igmp.h>           // Multicast group membership
+#include <timeHelper.h>          // Time keeping
+
+namespace beacon
+{
+/*********************************************************************************************\
+ * LAN time beacon
+ *
+ * Clocks on the same LAN agree on one leader: the lowest chip ID among those
+ * whose time came from NTP this boot. The leader multicasts its UTC a few
+ * times a minute; the others phase-lock to it and hold off their own NTP
+ * syncs while they follow. A clock that hears nobody better for
+ * leaderTimeout starts announcing itself, and one that hears a lower ID
+ * announcing stands down, so the group settles within a beacon interval.
+ *
+ * Packets are timestamped in the receive callback as lwIP delivers them,
+ * not when the loop next polls. Network and DTIM delays only ever make a
+ * beacon look late, so the offset applied is the largest (least delayed) of
+ * the last few samples.
+\*********************************************************************************************/
+
+constexpr uint32_t MAGIC = 0x4250544E;  // "NTPB"
+constexpr uint16_t port = 12123;
+constexpr uint32_t beaconInterval = 15000;  // ms between announcements
+constexpr uint32_t leaderTimeout = 3 * beaconInterval + 2000;
+constexpr uint8_t windowSize = 4;        // Samples in the delay filter
+constexpr int32_t stepThreshold = 1000;  // ms; larger offsets step at once
+const IPAddress group(239, 255, 12, 123);
+
+// Same firmware at both ends, so sent as is (little endian)
+struct Packet {
+  uint32_t magic;
+  uint32_t id;     // Sender's chip ID
+  uint64_t utcMs;  // Sender's UTC as the packet was written
+};
+
+bool enabled = false;
+bool hasNtpTime = false;  // Set by wifi::syncNtpTime(); only such clocks lead
+uint32_t id = 0;          // This clock's chip ID
+
+UdpContext *udp = nullptr;
+IPAddress joinedOn;        // Interface address the group was joined on
+uint32_t started = 0;      // millis() we started listening
+uint32_t lastService = 0;  // millis() of the last loopTask() pass
+uint32_t lastSent = 0;     // millis() of our last announcement
+uint32_t leaderId = 0;     // Clock we follow, 0 if none
+uint32_t leaderSeen = 0;   // millis() of its last beacon
+int32_t window[windowSize];  // Recent offsets, ms, relative to our clock now
+uint8_t windowNext = 0;
+uint8_t samples = 0;       // Valid entries in window
+int32_t lastOffset = 0;    // ms, the correction last applied
+uint32_t sent = 0;
+uint32_t received = 0;
+
+// Filled in by onRx(), read by loopTask(); lwIP runs between loop passes,
+// never inside one, so no further locking is needed
+Packet inbox;
+uint32_t inboxMicros = 0;  // micros() as it arrived
+volatile bool inboxReady = false;
+
+bool leading()
+{
+  return enabled && udp && !leaderId && hasNtpTime && timekeeping::isSet() &&
+         millis() - started >= leaderTimeout;
+}
+
+bool following() { return enabled && leaderId != 0; }
+
+/**
+ * @brief lwIP receive callback: stamp and copy the packet, nothing more
+ */
+void onRx()
+{
+  uint32_t now = micros();
+  while (udp->next()) {
+    if (udp->getSize() != sizeof(Packet)) continue;
+    udp->read((char *)&inbox, sizeof(inbox));
+    inboxMicros = now;
+    inboxReady = true;
+  }
+}
+
+void stop()
+{
+  if (udp) {
+    igmp_leavegroup(joinedOn, group);
+    udp->unref();
+    udp = nullptr;
+  }
+  leaderId = 0;
+  samples = windowNext = 0;
+}
+
+/**
+ * @brief Join the group on the current interface address
+ */
+bool start()
+{
+  joinedOn = WiFi.localIP();
+  if (igmp_joingroup(joinedOn, group) != ERR_OK) {
+    DebugPrintln("*Beacon: join failed");
+    return false;
+  }
+  udp = new UdpContext;
+  udp->ref();
+  if (!udp->listen(IPAddress(), port)) {
+    stop();
+    return false;
+  }
+  udp->setMulticastTTL(1);
+  udp->onRx(onRx);
+  started = millis();
+  DebugPrintf("*Beacon: listening, id %08X\n", id);
+  return true;
+}
+
+void setEnabled(bool enable)
+{
+  enabled = enable;
+  id = ESP.getChipId();
+  if (!enabled) stop();
+}
+
+void announce()
+{
+  Packet packet = {MAGIC, id, timekeeping::utcMillis()};
+  udp->append((const char *)&packet, sizeof(packet));
+  udp->send(group, port);
+  lastSent = millis();
+  sent++;
+}
+
+/**
+ * @brief Take one beacon: track the leader and fold its time into the
+ * phase lock
+ */
+void handle(const Packet &packet, uint32_t arrivalMicros)
+{
+  if (packet.magic != MAGIC || packet.id == id) return;
+  received++;
+
+  uint32_t now = millis();
+  // a clock that could lead itself only defers to lower IDs; otherwise
+  // stay with the current leader while it is alive
+  if (hasNtpTime && packet.id > id) return;
+  if (leaderId && packet.id != leaderId && packet.id > leaderId &&
+      now - leaderSeen < leaderTimeout) {
+    return;
+  }
+  if (packet.id != leaderId) {
+    DebugPrintf("*Beacon: following %08X\n", packet.id);
+    leaderId = packet.id;
+    samples = windowNext = 0;
+  }
+  leaderSeen = now;
+
+  uint32_t ageMs = (micros() - arrivalMicros) / 1000;
+  int64_t offset = (int64_t)packet.utcMs -
+                   (int64_t)(timekeeping::utcMillis() - ageMs);
+  if (!timekeeping::isSet() || offset <= -stepThreshold ||
+      offset >= stepThreshold) {
+    timekeeping::setUtcMillis(packet.utcMs + ageMs,
+                              timekeeping::monotonicMillis());
+    lastOffset = offset;
+    samples = windowNext = 0;
+    return;
+  }
+
+  window[windowNext] = offset;
+  windowNext = (windowNext + 1) % windowSize;
+  if (samples < windowSize) samples++;
+  int32_t best = window[0];
+  for (uint8_t i = 1; i < samples; i++) best = max(best, window[i]);
+  if (best) {
+    timekeeping::adjustMillis(best);
+    for (int32_t &w : window) w -= best;  // keep older samples comparable
+  }
+  lastOffset = best;
+}
+
+/**
+ * @brief Service the beacon; call once per loop while WiFi is connected
+ */
+void loopTask()
+{
+  if (!enabled) return;
+  if (udp && WiFi.localIP() != joinedOn) stop();  // address changed
+  if (!udp && !start()) return;
+
+  // not called while WiFi is down; having heard nothing then says nothing
+  // about the leader, so listen a full leaderTimeout again before leading
+  uint32_t now = millis();
+  if (now - lastService > beaconInterval) started = now;
+  lastService = now;
+
+  if (inboxReady) {
+    Packet packet = inbox;
+    uint32_t arrival = inboxMicros;
+    inboxReady = false;
+    handle(packet, arrival);
+  }
+
+  if (leaderId && millis() - leaderSeen >= leaderTimeout) {
+    DebugPrintln("*Beacon: leader lost");
+    leaderId = 0;
+    samples = windowNext = 0;
+  }
+
+  if (leading() && millis() - lastSent >= beaconInterval) announce();
+}
+}  // namespace beacon
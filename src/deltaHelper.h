@@ -0,0 +1,234 @@
+#pragma once
+
+#include <Updater.h>  // Flash update support
+#include <globals.h>  // Global libraries and variables
+
+/*********************************************************************************************\
+ * Streaming delta firmware patches, as produced by scripts/delta_ota.py
+ *
+ * Patch layout (little endian):
+ *   header  "NTPD", format (1), base size (4), base MD5 (16),
+ *           target size (4), target MD5 (16)
+ *   ops     0x01 COPY  offset (4), length (4)  - copy from running firmware
+ *           0x02 DATA  length (4), bytes       - literal bytes
+ *           0x00 END
+ *
+ * The patch is applied as it arrives: COPY reads the running sketch back
+ * from flash through a small buffer, DATA is passed straight on, and the
+ * result is streamed into the OTA partition by Updater. RAM use is bounded
+ * by copyBufferSize regardless of image or patch size.
+\*********************************************************************************************/
+
+namespace delta
+{
+constexpr uint8_t FORMAT = 1;
+constexpr uint8_t HEADER_SIZE = 4 + 1 + 4 + 16 + 4 + 16;
+constexpr size_t copyBufferSize = 512;
+
+constexpr uint8_t OP_END = 0x00;
+constexpr uint8_t OP_COPY = 0x01;
+constexpr uint8_t OP_DATA = 0x02;
+
+enum State : uint8_t {
+  STATE_IDLE,
+  STATE_HEADER,  // Collecting the header
+  STATE_OP,      // Waiting for an opcode
+  STATE_ARGS,    // Collecting opcode arguments
+  STATE_DATA,    // Passing literal bytes through
+  STATE_DONE,    // END seen
+  STATE_ERROR
+};
+
+State state = STATE_IDLE;
+uint8_t op = OP_END;
+uint8_t scratch[HEADER_SIZE];  // Header / argument bytes collected so far
+uint8_t have = 0;              // Bytes in scratch
+uint8_t need = 0;              // Bytes scratch must hold before parsing
+uint32_t remaining = 0;        // Literal bytes left in the current DATA op
+uint32_t baseSize = 0;
+uint32_t targetSize = 0;
+uint32_t written = 0;
+bool baseMismatch = false;  // Running firmware isn't the patch's base
+bool applied = false;       // Set only by a successful end()
+String error;
+
+uint32_t readLE32(const uint8_t *p)
+{
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+String toHex(const uint8_t *data, size_t len)
+{
+  static const char digits[] = "0123456789abcdef";
+  String hex;
+  hex.reserve(len * 2);
+  for (size_t i = 0; i < len; i++) {
+    hex += digits[data[i] >> 4];
+    hex += digits[data[i] & 0x0F];
+  }
+  return hex;
+}
+
+bool fail(const String &reason)
+{
+  if (state != STATE_ERROR) {
+    DebugPrintln("*Delta: " + reason);
+    error = reason;
+    state = STATE_ERROR;
+    if (Update.isRunning()) Update.end(false);
+  }
+  return false;
+}
+
+bool output(const uint8_t *data, size_t len)
+{
+  if (written + len > targetSize) return fail("patch overruns target size");
+  if (Update.write(const_cast<uint8_t *>(data), len) != len) {
+    return fail("flash write failed");
+  }
+  written += len;
+  return true;
+}
+
+bool copyFromBase(uint32_t offset, uint32_t length)
+{
+  alignas(4) uint8_t buffer[copyBufferSize];
+
+  if (offset > baseSize || length > baseSize - offset) {
+    return fail("copy outside base image");
+  }
+  while (length) {
+    size_t chunk = min<uint32_t>(length, sizeof(buffer));
+    if (!ESP.flashRead(offset, buffer, chunk)) return fail("flash read failed");
+    if (!output(buffer, chunk)) return false;
+    offset += chunk;
+    length -= chunk;
+  }
+  return true;
+}
+
+bool parseHeader()
+{
+  if (memcmp(scratch, "NTPD", 4) != 0 || scratch[4] != FORMAT) {
+    return fail("not a delta patch");
+  }
+  baseSize = readLE32(scratch + 5);
+  targetSize = readLE32(scratch + 25);
+
+  String baseMD5 = toHex(scratch + 9, 16);
+  if (baseSize != ESP.getSketchSize() || baseMD5 != ESP.getSketchMD5()) {
+    baseMismatch = true;
+    return fail("base firmware mismatch");
+  }
+
+  if (!Update.begin(targetSize)) return fail("not enough space for update");
+  Update.setMD5(toHex(scratch + 29, 16).c_str());
+
+  state = STATE_OP;
+  return true;
+}
+
+// Collect fixed size header / argument bytes into scratch
+size_t collect(const uint8_t *data, size_t len)
+{
+  size_t take = min<size_t>(len, need - have);
+  memcpy(scratch + have, data, take);
+  have += take;
+  return take;
+}
+
+void expect(State next, uint8_t bytes)
+{
+  state = next;
+  have = 0;
+  need = bytes;
+}
+
+void begin()
+{
+  error = "";
+  baseMismatch = false;
+  applied = false;
+  written = 0;
+  expect(STATE_HEADER, HEADER_SIZE);
+  DebugPrintln("*Delta: receiving patch");
+}
+
+/**
+ * @brief Feed the next chunk of patch data, in whatever sizes it arrives
+ */
+bool write(const uint8_t *data, size_t len)
+{
+  while (len && state != STATE_ERROR) {
+    size_t used = 0;
+
+    switch (state) {
+      case STATE_HEADER:
+        used = collect(data, len);
+        if (have == need) parseHeader();
+        break;
+
+      case STATE_OP:
+        op = data[0];
+        used = 1;
+        if (op == OP_END) {
+          state = STATE_DONE;
+        } else if (op == OP_COPY) {
+          expect(STATE_ARGS, 8);
+        } else if (op == OP_DATA) {
+          expect(STATE_ARGS, 4);
+        } else {
+          fail("unknown op");
+        }
+        break;
+
+      case STATE_ARGS:
+        used = collect(data, len);
+        if (have < need) break;
+        if (op == OP_COPY) {
+          state = STATE_OP;
+          copyFromBase(readLE32(scratch), readLE32(scratch + 4));
+        } else {
+          remaining = readLE32(scratch);
+          state = remaining ? STATE_DATA : STATE_OP;
+        }
+        break;
+
+      case STATE_DATA:
+        used = min<size_t>(len, remaining);
+        remaining -= used;
+        if (output(data, used) && !remaining) state = STATE_OP;
+        break;
+
+      case STATE_DONE:
+        return fail("data after end of patch");
+
+      default:
+        return fail("patch not started");
+    }
+
+    data += used;
+    len -= used;
+  }
+  return state != STATE_ERROR;
+}
+
+/**
+ * @brief Finish the update once the whole patch has arrived. The result is
+ * only committed if the patched image matches the target MD5.
+ */
+bool end()
+{
+  if (state == STATE_ERROR) return false;
+  if (state != STATE_DONE) return fail("patch truncated");
+  if (written != targetSize) return fail("patched image has wrong size");
+  if (!Update.end()) return fail("patched image failed MD5 check");
+
+  DebugPrintf("*Delta: applied, %u bytes written\n", written);
+  state = STATE_IDLE;
+  applied = true;
+  return true;
+}
+
+void abort() { fail("upload aborted"); }
+}  // namespace delta
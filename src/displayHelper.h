@@ -6,6 +6,7 @@
 #include <SPI.h>                 // SPI device support
 #include <globals.h>             // Global libraries and variables
 #include <sensorHelper.h>        // Sensor helper functions
+#include <timeHelper.h>          // Time keeping
 
 namespace display
 {
@@ -18,6 +19,7 @@ constexpr uint8_t displayUp = 0;
 constexpr uint8_t displayDown = 1;
 
 Max72xxPanel matrix = Max72xxPanel(pinCS, numHorzDisp, numVertDisp);
+bool blanked = false;  // Panel shut down, clock face not drawn
 
 void setRotation(int y)
 {
@@ -57,7 +59,7 @@ void printMsg(String msg)
   matrix.write();
 }
 
-void printProgress(int progress, int total)
+void printProgress(uint8_t percent)
 {
   matrix.fillScreen(LOW);  // Empty the screen
   matrix.setTextSize(1);
@@ -69,10 +71,10 @@ void printProgress(int progress, int total)
   matrix.drawPixel(7, 4, HIGH);
 
   matrix.setCursor(9, 0);
-  if ((progress / (total / 100)) < 10) {
+  if (percent < 10) {
     matrix.print("0");
   }
-  matrix.print((progress / (total / 100)));
+  matrix.print(percent);
   matrix.print("%");
   matrix.write();
 }
@@ -114,25 +116,29 @@ void scrollingText(String msg, uint8_t animationSpeed)
 
 void digitalClockDisplay()
 {
+  if (blanked) return;
+
+  const timekeeping::DateTime &t = timekeeping::local;
+
   matrix.fillScreen(LOW);  // Empty the screen
   matrix.setCursor(0, 0);  // Move the cursor to the end of the screen
-  if (hourFormat12() < 10) matrix.print(" ");
+  if (t.hour12 < 10) matrix.print(" ");
 
-  matrix.print(hourFormat12());  // Write the time
+  matrix.print(t.hour12);  // Write the time
 
-  if ((second() % 2) != 0) {
+  if ((t.second % 2) != 0) {
     matrix.drawPixel(12, 2, HIGH);
     matrix.drawPixel(12, 4, HIGH);
   }
 
   matrix.setCursor(14, 0);  // Move the cursor to the end of the screen
-  if (minute() < 10) {
+  if (t.minute < 10) {
     matrix.print("0");
   }
-  matrix.print(minute());
+  matrix.print(t.minute);
 
   matrix.setCursor(27, 0);
-  if (isAM()) {
+  if (t.isAM) {
     // draw an A
     matrix.drawPixel(28, 2, HIGH);  // *
     matrix.drawPixel(28, 3, HIGH);  // *
@@ -173,32 +179,44 @@ void digitalClockDisplay()
   matrix.write();
 
   // print time to debug also
-  DebugPrint(hour());
-  printDigits(minute());
-  printDigits(second());
+  DebugPrint(t.hour);
+  printDigits(t.minute);
+  printDigits(t.second);
   DebugPrint(" ");
-  DebugPrint(day());
+  DebugPrint(t.day);
   DebugPrint(".");
-  DebugPrint(month());
+  DebugPrint(t.month);
   DebugPrint(".");
-  DebugPrint(year());
+  DebugPrint(t.year);
   DebugPrintln();
 }
 
-void setDisplayOrientation(float Y)
+void setDisplayOrientation(uint8_t orientation)
 {
-  if (Y >= 40) {
-    DebugPrintf("Display up (%.2f)\n", Y);
-    display::setRotation(displayUp);
-  } else if (Y <= -40) {
-    DebugPrintf("Display down (%.2f)\n", Y);
+  if (orientation == sensor::ORIENTATION_DOWN) {
+    DebugPrintln("Display down");
     display::setRotation(displayDown);
   } else {
-    DebugPrintf("Display don't know (%.2f)\n", Y);
+    DebugPrintln("Display up");
     display::setRotation(displayUp);
   }
 }
 
+/**
+ * @brief Shut the panel down (no drive current, no SPI redraws) or wake it;
+ * the clock face is redrawn on the next second
+ */
+void setBlank(bool blank)
+{
+  blanked = blank;
+  matrix.shutdown(blank);
+}
+
+void setBrightness(uint8_t brightness)
+{
+  matrix.setIntensity(min<uint8_t>(brightness, 15));
+}
+
 void setup(uint8_t brightness)
 {
   matrix.setIntensity(brightness);  // Set brightness between 0 and 15
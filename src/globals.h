@@ -8,14 +8,18 @@
 #define DEVICE_NAME "NTP Clock"
 
 #include <Arduino.h>       // Arduino core functions
-#include <TimeLib.h>       // Friendly time formatting and timekeeping
 #include <debug-helper.h>  // Debug macros
 
 inline constexpr uint32_t sleepTime = 50;  // Duration to sleep between loops
-inline uint32_t uptime;  // Counting every second until 4294967295 = 130 year
+inline uint32_t uptime;  // Seconds since boot, kept by timekeeping::tick()
 inline uint32_t loop_load_avg;  // Indicative loop load average
 
-inline bool restartDevice = false;    // Flag that device restart requested
-inline constexpr int timeZone = 10;   // AEST
-inline constexpr int BUTTON_PIN = 0;  // Connect button between GPIO0 and GND
+inline bool restartDevice = false;      // Flag that device restart requested
+inline constexpr char defaultTimezone[] = "AEST-10";  // POSIX TZ string
+inline constexpr uint8_t defaultBrightness = 1;  // Display intensity, 0 - 15
+inline constexpr int BUTTON_PIN = 0;    // Connect button between GPIO0 and GND
+// MPU6050 INT output to GPIO12. This is also HSPI MISO, which the display
+// never reads but SPI.begin() (run by the global Max72xxPanel's constructor)
+// still claims; initGyro() must set the pin back to INPUT after that.
+inline constexpr int MPU_INT_PIN = 12;
 inline constexpr uint32_t ntpUpdateInterval = 60 * 60 * 8;  // every eight hours
@@ -0,0 +1,317 @@
+#pragma once
+
+#include <flash_hal.h>   // Flash layout (filesystem area) and sector size
+#include <globals.h>     // Global libraries and variables
+#include <timeHelper.h>  // Time keeping
+
+namespace journal
+{
+/*********************************************************************************************\
+ * Persistent event journal
+ *
+ * An append-only log in a ring of raw flash sectors at the start of the
+ * filesystem area (unused while LittleFS is disabled; shrink it with
+ * board_build.filesystem_size before enabling one). Each sector starts with
+ * a header slot carrying a sequence number; records fill the rest of the
+ * sector, and once it is full the oldest sector in the ring is erased and
+ * reused, so wear spreads evenly over all of them.
+ *
+ * Records are held in RAM and written a flash page at a time by loopTask(),
+ * once a page's worth is queued or flushDelay after the first one was, and
+ * by logRestart() / an explicit flush() before a restart. append() itself
+ * never touches flash, so event sites can log freely; should the loop fall a
+ * whole buffer behind, further records are dropped (and counted).
+\*********************************************************************************************/
+
+enum Event : uint8_t {
+  EVENT_BOOT,         // value: reset reason (rst_info.reason)
+  EVENT_CRASH,        // value: faulting PC (rst_info.epc1), after EVENT_BOOT
+  EVENT_RESTART,      // value: RestartCause
+  EVENT_WIFI_DOWN,    // value: outage, seconds (logged on reconnect)
+  EVENT_NTP_FAIL,     // value: wifi::NtpResult, first failure of a run
+  EVENT_OTA_START,    // value: OtaKind
+  EVENT_OTA_DONE,     // value: KB/s
+  EVENT_OTA_FAILED,   // value: KB/s up to the failure
+  EVENT_NTP_OK,       // value: failed attempts before this sync succeeded
+};
+
+enum RestartCause : uint8_t {
+  RESTART_REQUESTED,
+  RESTART_WIFI_TIMEOUT,
+  RESTART_WIFI_ERASED
+};
+enum OtaKind : uint8_t { OTA_ARDUINO, OTA_DELTA };
+
+struct Record {
+  uint32_t utc;     // UTC seconds, 0 if the clock wasn't set yet
+  uint32_t uptime;  // Seconds since boot
+  uint32_t value;   // Meaning depends on type
+  uint16_t boot;    // Boot counter, groups the records of one run
+  uint8_t type;     // Event
+  uint8_t check;    // Guards against torn writes
+};
+static_assert(sizeof(Record) == 16, "Record should pack to 16 bytes");
+
+constexpr uint32_t MAGIC = 0x4A50544E;  // "NTPJ"
+constexpr uint8_t sectors = 4;          // Ring of 4 KB sectors
+constexpr uint16_t slotsPerSector = FLASH_SECTOR_SIZE / sizeof(Record);
+constexpr uint8_t slotsPerPage = 256 / sizeof(Record);
+constexpr uint32_t flushDelay = 5 * 60 * 1000;  // ms a record may wait in RAM
+
+uint8_t head = 0;               // Sector being appended to
+uint32_t headSequence = 0;      // Its sequence number
+uint16_t nextSlot = 0;          // Next free slot in it, 0 until begin()
+uint16_t used[sectors];         // Records held per sector
+uint16_t bootCount = 0;
+Record pending[2 * slotsPerPage];  // Queued for the next flush
+uint8_t pendingCount = 0;
+uint32_t pendingSince = 0;      // millis() when the first was queued
+uint16_t dropped = 0;           // Records lost to a full queue
+bool restartLogged = false;
+
+uint8_t recordCheck(const Record &r)
+{
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(&r);
+  uint8_t sum = 0x5A;
+  for (size_t i = 0; i < offsetof(Record, check); i++) sum += p[i];
+  return sum;
+}
+
+uint32_t slotAddress(uint8_t sector, uint16_t slot)
+{
+  return FS_PHYS_ADDR + sector * FLASH_SECTOR_SIZE + slot * sizeof(Record);
+}
+
+bool readSlot(uint8_t sector, uint16_t slot, Record &r)
+{
+  return ESP.flashRead(slotAddress(sector, slot), (uint32_t *)&r, sizeof(r));
+}
+
+bool isErased(const Record &r)
+{
+  const uint32_t *w = reinterpret_cast<const uint32_t *>(&r);
+  return (w[0] & w[1] & w[2] & w[3]) == UINT32_MAX;
+}
+
+/**
+ * @brief Sequence number of a sector, or 0 if its header isn't valid
+ */
+uint32_t sectorSequence(uint8_t sector)
+{
+  Record header;
+  if (!readSlot(sector, 0, header)) return 0;
+  if (header.utc != MAGIC || header.value != ~header.uptime) return 0;
+  return header.uptime;
+}
+
+/**
+ * @brief Erase the next sector in the ring and make it the head
+ */
+bool startSector(uint8_t sector, uint32_t sequence)
+{
+  uint32_t first = FS_PHYS_ADDR / FLASH_SECTOR_SIZE;
+  Record header = {MAGIC, sequence, ~sequence, 0xFFFF, 0xFF, 0xFF};
+  if (!ESP.flashEraseSector(first + sector) ||
+      !ESP.flashWrite(slotAddress(sector, 0), (uint32_t *)&header,
+                      sizeof(header))) {
+    DebugPrintln("*Journal: sector write failed");
+    return false;
+  }
+  head = sector;
+  headSequence = sequence;
+  nextSlot = 1;
+  used[sector] = 0;
+  return true;
+}
+
+/**
+ * @brief Write out queued records, a page at a time
+ */
+void flush()
+{
+  if (!nextSlot) pendingCount = 0;  // no usable journal, drop them
+  if (!pendingCount) return;
+
+  uint8_t done = 0;
+  while (done < pendingCount) {
+    if (nextSlot == slotsPerSector &&
+        !startSector((head + 1) % sectors, headSequence + 1)) {
+      break;
+    }
+    // never let one program operation cross a flash page
+    uint8_t n = min<uint16_t>(pendingCount - done,
+                              slotsPerPage - nextSlot % slotsPerPage);
+    if (!ESP.flashWrite(slotAddress(head, nextSlot),
+                        (uint32_t *)&pending[done], n * sizeof(Record))) {
+      DebugPrintln("*Journal: write failed");
+      break;
+    }
+    nextSlot += n;
+    used[head] += n;
+    done += n;
+  }
+  pendingCount = 0;
+}
+
+/**
+ * @brief Queue an event for the journal
+ */
+void append(Event type, uint32_t value)
+{
+  if (pendingCount == sizeof(pending) / sizeof(pending[0])) {
+    dropped++;
+    return;
+  }
+  if (!pendingCount) pendingSince = millis();
+
+  Record &r = pending[pendingCount++];
+  r.utc = timekeeping::isSet() ? timekeeping::utcNow() : 0;
+  r.uptime = uptime;
+  r.value = value;
+  r.boot = bootCount;
+  r.type = type;
+  r.check = recordCheck(r);
+}
+
+/**
+ * @brief Find the head of the ring (formatting it if there is none), count
+ * the records held and log this boot with its reset reason
+ */
+void begin()
+{
+  uint32_t newest = 0;
+  int32_t lastBoot[sectors];  // Boot counter of each sector's last record
+  for (uint8_t s = 0; s < sectors; s++) {
+    uint32_t sequence = sectorSequence(s);
+    used[s] = 0;
+    lastBoot[s] = -1;
+    if (!sequence) continue;
+    uint16_t slot = 1;
+    Record r;
+    while (slot < slotsPerSector && readSlot(s, slot, r) && !isErased(r)) {
+      if (r.check == recordCheck(r)) {
+        used[s]++;
+        lastBoot[s] = r.boot;
+      }
+      slot++;
+    }
+    if (sequence > newest) {
+      newest = sequence;
+      head = s;
+      headSequence = sequence;
+      nextSlot = slot;
+    }
+  }
+
+  if (newest) {
+    // the head sector may have only just been started
+    int32_t last = lastBoot[head];
+    if (last < 0) last = lastBoot[(head + sectors - 1) % sectors];
+    bootCount = last + 1;
+  } else {
+    DebugPrintln("*Journal: none found, formatting");
+    bootCount = 0;
+    if (!startSector(0, 1)) return;
+  }
+
+  const rst_info *reset = ESP.getResetInfoPtr();
+  append(EVENT_BOOT, reset->reason);
+  if (reset->reason == REASON_EXCEPTION_RST ||
+      reset->reason == REASON_SOFT_WDT_RST || reset->reason == REASON_WDT_RST) {
+    append(EVENT_CRASH, reset->epc1);
+  }
+}
+
+/**
+ * @brief Flush once a page's worth is queued or the oldest queued record has
+ * waited flushDelay; call from the loop after the display has been drawn, so
+ * the write lands in slack time
+ */
+void loopTask()
+{
+  if (pendingCount >= slotsPerPage ||
+      (pendingCount && millis() - pendingSince >= flushDelay)) {
+    flush();
+  }
+}
+
+/**
+ * @brief Log a restart about to happen and write everything out. Only the
+ * first call counts, as ESP.restart() takes effect once the loop yields.
+ */
+void logRestart(RestartCause cause)
+{
+  if (restartLogged) return;
+  restartLogged = true;
+  append(EVENT_RESTART, cause);
+  flush();
+}
+
+uint32_t recordCount()
+{
+  uint32_t count = pendingCount;
+  for (uint8_t s = 0; s < sectors; s++) count += used[s];
+  return count;
+}
+
+/**
+ * @brief Visit every valid record, oldest first, including those still
+ * queued in RAM
+ */
+template <typename Fn>
+void forEach(Fn fn)
+{
+  if (nextSlot) {
+    for (uint8_t i = 1; i <= sectors; i++) {
+      uint8_t s = (head + i) % sectors;
+      if (!sectorSequence(s)) continue;
+      Record r;
+      for (uint16_t slot = 1; slot < slotsPerSector; slot++) {
+        if (!readSlot(s, slot, r) || isErased(r)) break;
+        if (r.check == recordCheck(r)) fn(r);
+      }
+    }
+  }
+  for (uint8_t i = 0; i < pendingCount; i++) fn(pending[i]);
+}
+
+const char *eventName(uint8_t type)
+{
+  switch (type) {
+    case EVENT_BOOT: return "boot";
+    case EVENT_CRASH: return "crash";
+    case EVENT_RESTART: return "restart";
+    case EVENT_WIFI_DOWN: return "wifi-down";
+    case EVENT_NTP_FAIL: return "ntp-fail";
+    case EVENT_OTA_START: return "ota-start";
+    case EVENT_OTA_DONE: return "ota-done";
+    case EVENT_OTA_FAILED: return "ota-failed";
+    case EVENT_NTP_OK: return "ntp-ok";
+    default: return "unknown";
+  }
+}
+
+const char *restartCauseName(uint32_t cause)
+{
+  switch (cause) {
+    case RESTART_REQUESTED: return "requested";
+    case RESTART_WIFI_TIMEOUT: return "wifi-timeout";
+    case RESTART_WIFI_ERASED: return "wifi-erased";
+    default: return "unknown";
+  }
+}
+
+const char *resetReasonName(uint32_t reason)
+{
+  switch (reason) {
+    case REASON_DEFAULT_RST: return "power-on";
+    case REASON_WDT_RST: return "hardware-watchdog";
+    case REASON_EXCEPTION_RST: return "exception";
+    case REASON_SOFT_WDT_RST: return "software-watchdog";
+    case REASON_SOFT_RESTART: return "restart";
+    case REASON_DEEP_SLEEP_AWAKE: return "deep-sleep-wake";
+    case REASON_EXT_SYS_RST: return "external-reset";
+    default: return "unknown";
+  }
+}
+}  // namespace journal
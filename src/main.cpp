@@ -16,39 +16,49 @@
  *
 */
 
+#include <beaconHelper.h>     // LAN time beacon
 #include <displayHelper.h>    // Display helper functions
-#include <elapsedMillis.h>    // Non-blocking delays / event timers
 #include <globals.h>          // Global libraries and variables
+#include <journalHelper.h>    // Persistent event journal
+#include <scheduleHelper.h>   // Scheduled actions
 #include <sensorHelper.h>     // Sensor helper functions
+#include <settingsHelper.h>   // Persistent settings
 #include <sleepHelper.h>      // Sleep helper functions
+#include <timeHelper.h>       // Time keeping
 #include <webserverHelper.h>  // Web server helper functions
 #include <wifiHelper.h>       // WiFi helper functions
 
-elapsedMillis orientationCheck;
-constexpr uint16_t orientationCheckInterval = 500;
 constexpr uint8_t delayAfterRestart = 100;
 constexpr uint16_t wifiDisconnectDelayBeforeRestart = 60 * 5;
-time_t prevDisplay = 0;  // time when the digital clock was displayed last
 
 void setup()
 {
   DebugBegin(115200);
   DebugInfo();
 
+  settings::load();
+  journal::begin();
+  if (!timekeeping::setZone(settings::current.timezone)) {
+    timekeeping::setZone(defaultTimezone);
+  }
+
   sensor::useIMU = true;
   sensor::initGyro();
 
-  display::setDisplayOrientation(sensor::gyroGetValue(sensor::Y_AXIS, true));
-  display::setup(1);
+  display::setDisplayOrientation(sensor::orientation);
+  display::setup(defaultBrightness);
 
   wifi::setupWifi();
   wifi::setupUDP();
   wifi::setupOTA();
   wifi::setupNTP(ntpUpdateInterval);
+  sleep::setPowerMode(settings::current.powerMode);
+  beacon::setEnabled(settings::current.beacon);
 
   webserver::setupHTTP();
 
-  sensor::button.begin();
+  sensor::initButton();
+  schedule::rebuild();
 
   display::printMsg("Ready");
 }
@@ -56,40 +66,57 @@ void setup()
 void loop()
 {
   uint32_t loopStart = millis();
-  sleep::updateUptime();
+  bool newSecond = timekeeping::tick();
 
   wifi::WifiCheckState();
 
   if (WiFi.status() == WL_CONNECTED) {
     wifi::otaLoopTask();
+    wifi::ntpLoopTask();
+    beacon::loopTask();
     webserver::loopTask();
   }
 
-  // check if gyro orientation has changed and rotate display accordingly
-  sensor::gyroUpdate();
-  if (orientationCheck > orientationCheckInterval) {
-    orientationCheck = 0;  // reset counter
-    display::setDisplayOrientation(sensor::gyroGetValue(sensor::Y_AXIS, false));
+  // rotate display if the motion interrupt reported a change in orientation
+  if (sensor::orientationUpdate()) {
+    display::setDisplayOrientation(sensor::orientation);
   }
 
-  // update display if time set and has changed
-  if (timeStatus() != timeNotSet) {
-    if (now() != prevDisplay) {
-      prevDisplay = now();
-      display::digitalClockDisplay();
-    }
-  }
+  // brightness, blanking and reminders due this second
+  schedule::loopTask(newSecond);
 
-  // message / action if button pressed
-  if (sensor::button.pressed()) {
-    DebugPrintln("Button Pressed!");
-    display::scrollingText("Let go of me!", 30);
+  // update display once per second, when the time core ticks
+  if (newSecond) {
+    sleep::markSecondBoundary();
+    display::digitalClockDisplay();
+  }
+  journal::loopTask();
+
+  // message / action for button gestures
+  switch (sensor::buttonGesture()) {
+    case sensor::GESTURE_SINGLE:
+      DebugPrintln("Button Pressed!");
+      display::scrollingText("Let go of me!", 30);
+      break;
+    case sensor::GESTURE_DOUBLE:
+      DebugPrintln("Button Double Pressed!");
+      display::scrollingText(WiFi.localIP().toString(), 30);
+      break;
+    case sensor::GESTURE_LONG:
+      DebugPrintln("Button Long Pressed!");
+      display::printMsg("Sync");
+      wifi::setupNTP(ntpUpdateInterval);
+      break;
+    default:
+      break;
   }
 
   // Restart command received or WiFi down for more than specified time
   if (restartDevice == true ||
       ((WiFi.status() != WL_CONNECTED) &&
        (wifi::downtime >= wifiDisconnectDelayBeforeRestart))) {
+    journal::logRestart(restartDevice ? journal::RESTART_REQUESTED
+                                      : journal::RESTART_WIFI_TIMEOUT);
     ESP.restart();
     delay(delayAfterRestart);
   }
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <displayHelper.h>   // Display helper functions
+#include <globals.h>         // Global libraries and variables
+#include <settingsHelper.h>  // Persistent settings
+#include <timeHelper.h>      // Time keeping
+#include <wifiHelper.h>      // WiFi helper functions
+
+namespace schedule
+{
+using timekeeping::SECS_PER_DAY;
+using timekeeping::SECS_PER_HOUR;
+using timekeeping::SECS_PER_MIN;
+
+/*********************************************************************************************\
+ * Scheduled actions
+ *
+ * The rules in settings::current.schedule are kept in a min-heap keyed by
+ * their next fire time in UTC, so each second only the root is compared.
+ * Keys are absolute instants, so NTP's sub-second corrections leave them
+ * valid; a step of a second or more, or a change of zone, recomputes them.
+ * Intensity and blanking are replayed from their latest past occurrence on
+ * every rebuild, so a clock that boots inside a blanking window stays dark.
+\*********************************************************************************************/
+
+enum Action : uint8_t {
+  ACTION_NONE,
+  ACTION_INTENSITY,  // Set display brightness to value (0 - 15)
+  ACTION_BLANK,      // Shut the display down
+  ACTION_UNBLANK,    // Wake the display
+  ACTION_REMINDER,   // Scroll text across the display
+  ACTION_NTP_SYNC,   // Sync time now
+  ACTION_COUNT
+};
+
+constexpr uint8_t EVERY_DAY = 0x7F;
+constexpr uint8_t WEEKDAYS = 0x3E;
+constexpr uint8_t WEEKENDS = 0x41;
+
+struct Entry {
+  time_t next;   // UTC
+  uint8_t rule;  // Index into settings::current.schedule
+};
+
+Entry heap[settings::scheduleSize];
+uint8_t heapSize = 0;
+int64_t builtOffsetMs = 0;  // timekeeping::utcOffsetMs the keys were built at
+uint16_t builtZone = 0;     // timekeeping::zoneChanges likewise
+
+const char *actionName(uint8_t action)
+{
+  switch (action) {
+    case ACTION_INTENSITY: return "Brightness";
+    case ACTION_BLANK: return "Display off";
+    case ACTION_UNBLANK: return "Display on";
+    case ACTION_REMINDER: return "Reminder";
+    case ACTION_NTP_SYNC: return "Sync time";
+    default: return "Unused";
+  }
+}
+
+const settings::ScheduleRule &rule(uint8_t i)
+{
+  return settings::current.schedule[i];
+}
+
+/**
+ * @brief Next occurrence of a rule after utc or, with after false, the latest
+ * at or before it
+ *
+ * @return UTC, or 0 if the rule has no days set
+ */
+time_t occurrence(const settings::ScheduleRule &r, time_t utc, bool after)
+{
+  time_t local = timekeeping::toLocal(utc);
+  time_t at = local - local % SECS_PER_DAY + r.hour * SECS_PER_HOUR +
+              r.minute * SECS_PER_MIN;
+
+  // a week and a day covers every weekday from either side of today's time
+  for (int8_t d = 0; d <= 7; d++) {
+    time_t candidate = at + (after ? d : -d) * SECS_PER_DAY;
+    uint8_t weekday = (candidate / SECS_PER_DAY + 4) % 7;  // 1970 was Thursday
+    if (!(r.days & (1 << weekday))) continue;
+    time_t instant = timekeeping::toUtc(candidate);
+    if (after ? instant > utc : instant <= utc) return instant;
+  }
+  return 0;
+}
+
+void siftDown(uint8_t i)
+{
+  while (true) {
+    uint8_t smallest = i;
+    uint8_t left = 2 * i + 1;
+    uint8_t right = left + 1;
+    if (left < heapSize && heap[left].next < heap[smallest].next) {
+      smallest = left;
+    }
+    if (right < heapSize && heap[right].next < heap[smallest].next) {
+      smallest = right;
+    }
+    if (smallest == i) return;
+    std::swap(heap[i], heap[smallest]);
+    i = smallest;
+  }
+}
+
+void push(time_t next, uint8_t i)
+{
+  uint8_t pos = heapSize++;
+  heap[pos] = {next, i};
+  while (pos && heap[(pos - 1) / 2].next > heap[pos].next) {
+    std::swap(heap[pos], heap[(pos - 1) / 2]);
+    pos = (pos - 1) / 2;
+  }
+}
+
+void run(uint8_t i)
+{
+  const settings::ScheduleRule &r = rule(i);
+  DebugPrintf("*Schedule: %s\n", actionName(r.action));
+
+  switch (r.action) {
+    case ACTION_INTENSITY:
+      display::setBrightness(r.value);
+      break;
+    case ACTION_BLANK:
+      display::setBlank(true);
+      break;
+    case ACTION_UNBLANK:
+      display::setBlank(false);
+      break;
+    case ACTION_REMINDER:
+      if (!display::blanked) display::scrollingText(r.text, 30);
+      break;
+    case ACTION_NTP_SYNC:
+      wifi::setupNTP(wifi::ntpSyncInterval);
+      break;
+  }
+}
+
+/**
+ * @brief Recompute every rule's next fire time and restore the brightness and
+ * blanking the schedule says should be in effect now
+ */
+void rebuild()
+{
+  heapSize = 0;
+  builtOffsetMs = timekeeping::utcOffsetMs;
+  builtZone = timekeeping::zoneChanges;
+  if (!timekeeping::isSet()) return;
+
+  time_t now = timekeeping::utcNow();
+  time_t latestIntensity = 0;
+  time_t latestBlank = 0;
+  int8_t intensityRule = -1;
+  int8_t blankRule = -1;
+
+  for (uint8_t i = 0; i < settings::scheduleSize; i++) {
+    const settings::ScheduleRule &r = rule(i);
+    if (r.action == ACTION_NONE || r.action >= ACTION_COUNT) continue;
+    time_t next = occurrence(r, now, true);
+    if (!next) continue;
+    push(next, i);
+
+    time_t last = occurrence(r, now, false);
+    if (r.action == ACTION_INTENSITY && last > latestIntensity) {
+      latestIntensity = last;
+      intensityRule = i;
+    } else if ((r.action == ACTION_BLANK || r.action == ACTION_UNBLANK) &&
+               last > latestBlank) {
+      latestBlank = last;
+      blankRule = i;
+    }
+  }
+
+  display::setBrightness(intensityRule < 0 ? defaultBrightness
+                                           : rule(intensityRule).value);
+  display::setBlank(blankRule >= 0 && rule(blankRule).action == ACTION_BLANK);
+}
+
+/**
+ * @brief Run whatever has come due; call once per loop with tick()'s result
+ */
+void loopTask(bool newSecond)
+{
+  if (!newSecond) return;
+
+  int64_t step = timekeeping::utcOffsetMs - builtOffsetMs;
+  if (step <= -1000 || step >= 1000 || timekeeping::zoneChanges != builtZone) {
+    rebuild();
+    return;
+  }
+
+  time_t now = timekeeping::utcNow();
+  while (heapSize && heap[0].next <= now) {
+    uint8_t i = heap[0].rule;
+    run(i);
+    heap[0].next = occurrence(rule(i), now, true);
+    siftDown(0);
+  }
+}
+}  // namespace schedule
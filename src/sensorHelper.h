@@ -1,22 +1,506 @@
 #pragma once
 
-#include <Button.h>         // Simple button library
-#include <MPU6050_tockn.h>  // MPU6050 Gyro + Accelometer
-#include <Wire.h>           // I2C device support
-#include <globals.h>        // Global libraries and variables
+#include <Wire.h>            // I2C device support
+#include <globals.h>         // Global libraries and variables
+#include <settingsHelper.h>  // Persistent settings
+#include <sleepHelper.h>     // Sleep helper functions
 
 namespace sensor
 {
-Button button(BUTTON_PIN);
+bool useIMU = true;
 
-MPU6050 mpu6050(Wire);
+// MPU6050 I2C address and registers
+constexpr uint8_t MPU6050_ADDR = 0x68;
+constexpr uint8_t REG_SMPLRT_DIV = 0x19;
+constexpr uint8_t REG_CONFIG = 0x1A;
+constexpr uint8_t REG_GYRO_CONFIG = 0x1B;
+constexpr uint8_t REG_ACCEL_CONFIG = 0x1C;
+constexpr uint8_t REG_MOT_THR = 0x1F;
+constexpr uint8_t REG_MOT_DUR = 0x20;
+constexpr uint8_t REG_FIFO_EN = 0x23;
+constexpr uint8_t REG_INT_PIN_CFG = 0x37;
+constexpr uint8_t REG_INT_ENABLE = 0x38;
+constexpr uint8_t REG_INT_STATUS = 0x3A;
+constexpr uint8_t REG_ACCEL_XOUT_H = 0x3B;
+constexpr uint8_t REG_USER_CTRL = 0x6A;
+constexpr uint8_t REG_PWR_MGMT_1 = 0x6B;
+constexpr uint8_t REG_PWR_MGMT_2 = 0x6C;
+constexpr uint8_t REG_FIFO_COUNT_H = 0x72;
+constexpr uint8_t REG_FIFO_R_W = 0x74;
+constexpr uint8_t REG_WHO_AM_I = 0x75;
 
-bool useIMU = true;
+constexpr uint8_t INT_FIFO_OFLOW = 0x10;  // INT_STATUS FIFO overflow bit
+
+constexpr uint8_t ORIENTATION_UP = 0;
+constexpr uint8_t ORIENTATION_DOWN = 1;
+
+constexpr int32_t orientationThreshold = 40000;  // Y tilt (mdeg) to flip
+
+constexpr uint16_t motionSettleTime = 300;  // ms of quiet before re-reading
+constexpr uint8_t motionThreshold = 20;     // ~40mg of movement wakes us
+constexpr uint8_t motionDuration = 1;       // ms above threshold
+
+// Motion tracking: accel + gyro sampled into the FIFO at trackingRate
+constexpr uint16_t trackingRate = 100;    // Hz
+constexpr uint8_t fifoSampleSize = 12;    // accel XYZ + gyro XYZ
+constexpr uint8_t fifoBurstSamples = 10;  // per I2C read, fits Wire buffer
+constexpr uint16_t gyroCalibrationSamples = 100;
+constexpr int32_t gyroLsbPerDps10 = 655;  // +/-500dps: 65.5 LSB per dps
+constexpr int32_t filterAccelShare = 50;  // 1/50 accel, 49/50 gyro
+
+uint8_t orientation = ORIENTATION_UP;  // Last debounced display orientation
+
+volatile bool motionDetected = false;  // Set by motion interrupt
+bool orientationPending = false;       // Motion seen, waiting to settle
+uint32_t lastMotion = 0;               // millis() of last motion interrupt
+
+bool tracking = false;         // FIFO motion tracking running
+int32_t angleX = 0;            // Filtered tilt in micro degrees
+int32_t angleY = 0;            // Filtered tilt in micro degrees
+uint32_t samplesFiltered = 0;  // Samples pushed through the filter
+
+// atan(i / 32) in millidegrees, for i = 0..32
+constexpr int32_t atanTable[33] PROGMEM = {
+    0,     1790,  3576,  5356,  7125,  8881,  10620, 12339, 14036,
+    15709, 17354, 18970, 20556, 22109, 23629, 25115, 26565, 27979,
+    29358, 30700, 32005, 33275, 34509, 35707, 36870, 37999, 39094,
+    40156, 41186, 42184, 43152, 44091, 45000};
+
+// Button gestures, as returned by buttonGesture()
+enum Gesture : uint8_t {
+  GESTURE_NONE,
+  GESTURE_SINGLE,
+  GESTURE_DOUBLE,
+  GESTURE_LONG
+};
+
+constexpr uint16_t debounceTime = 25;     // ms a level must hold to count
+constexpr uint16_t doubleClickGap = 300;  // ms between clicks of a double
+constexpr uint16_t longPressTime = 1000;  // ms held for a long press
+
+// Button edges, timestamped by the ISR. Single producer (ISR) / single
+// consumer (loop) ring, so no locking is needed; size must be a power of 2.
+struct ButtonEdge {
+  uint32_t time;
+  uint8_t level;
+};
+constexpr uint8_t edgeQueueSize = 32;
+volatile ButtonEdge edgeQueue[edgeQueueSize];
+volatile uint8_t edgeHead = 0;       // Next slot the ISR writes
+volatile uint8_t edgeTail = 0;       // Next slot the loop reads
+volatile uint16_t edgeOverruns = 0;  // Edges merged because queue was full
+
+constexpr uint8_t gestureQueueSize = 4;
+Gesture gestureQueue[gestureQueueSize];
+uint8_t gestureCount = 0;
+
+uint8_t stableLevel = HIGH;  // Debounced level, button pulls to GND
+uint8_t rawLevel = HIGH;     // Level after the latest edge
+uint32_t rawTime = 0;        // When the latest edge happened
+uint32_t pressTime = 0;      // Debounced press time
+uint32_t releaseTime = 0;    // Debounced release time
+uint8_t clicks = 0;          // Short presses waiting to become a gesture
+bool longFired = false;      // Long press already reported for this press
+
+void IRAM_ATTR motionISR() { motionDetected = true; }
+
+void IRAM_ATTR buttonISR()
+{
+  uint8_t head = edgeHead;
+  uint8_t next = (head + 1) & (edgeQueueSize - 1);
+
+  if (next == edgeTail) {
+    // full: fold this edge into the newest queued one, so whatever else is
+    // lost the decoder still ends on the level the button is really at
+    edgeOverruns++;
+    uint8_t last = (head - 1) & (edgeQueueSize - 1);
+    edgeQueue[last].time = millis();
+    edgeQueue[last].level = digitalRead(BUTTON_PIN);
+  } else {
+    edgeQueue[head].time = millis();
+    edgeQueue[head].level = digitalRead(BUTTON_PIN);
+    edgeHead = next;
+  }
+  sleep::requestWake();
+}
+
+uint32_t isqrt(uint32_t n)
+{
+  uint32_t root = 0;
+  uint32_t bit = 1UL << 30;
+
+  while (bit > n) bit >>= 2;
+  while (bit) {
+    if (n >= root + bit) {
+      n -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+
+/**
+ * @brief atan2 in millidegrees using a 33 entry lookup table with linear
+ * interpolation, good to ~0.02 degrees and no floating point
+ */
+int32_t atan2Milli(int32_t y, int32_t x)
+{
+  if (x == 0 && y == 0) return 0;
+
+  uint32_t ax = abs(x);
+  uint32_t ay = abs(y);
+  bool steep = ay > ax;
+  uint32_t num = steep ? ax : ay;
+  uint32_t den = steep ? ay : ax;
+
+  // ratio 0..1 as table index (5 bits) + interpolation fraction (8 bits)
+  uint32_t ratio = (num << 13) / den;
+  uint32_t idx = ratio >> 8;
+  int32_t angle = pgm_read_dword(&atanTable[idx]);
+  if (idx < 32) {
+    int32_t next = pgm_read_dword(&atanTable[idx + 1]);
+    angle += ((next - angle) * (int32_t)(ratio & 0xFF)) >> 8;
+  }
+
+  if (steep) angle = 90000 - angle;
+  if (x < 0) angle = 180000 - angle;
+  return y < 0 ? -angle : angle;
+}
+
+void writeRegister(uint8_t reg, uint8_t data)
+{
+  Wire.beginTransmission(MPU6050_ADDR);
+  Wire.write(reg);
+  Wire.write(data);
+  Wire.endTransmission();
+}
+
+// Burst read consecutive registers, returns number of bytes read
+uint8_t readRegisters(uint8_t reg, uint8_t *buf, uint8_t len)
+{
+  Wire.beginTransmission(MPU6050_ADDR);
+  Wire.write(reg);
+  if (Wire.endTransmission(false) != 0) return 0;
+
+  uint8_t count = Wire.requestFrom(MPU6050_ADDR, len);
+  for (uint8_t i = 0; i < count; i++) buf[i] = Wire.read();
+  return count;
+}
+
+uint8_t readRegister(uint8_t reg)
+{
+  uint8_t data = 0;
+  readRegisters(reg, &data, 1);
+  return data;
+}
+
+inline int16_t toInt16(const uint8_t *raw) { return raw[0] << 8 | raw[1]; }
+
+// Accelerometer tilt (mdeg) around X and Y from one raw XYZ sample
+int32_t accelTiltX(const uint8_t *raw)
+{
+  int32_t accX = toInt16(raw);
+  int32_t accY = toInt16(raw + 2);
+  int32_t accZ = toInt16(raw + 4);
+  uint32_t magnitude = isqrt((uint32_t)(accX * accX) + (uint32_t)(accZ * accZ));
+  return atan2Milli(accY, magnitude);
+}
+
+int32_t accelTiltY(const uint8_t *raw)
+{
+  int32_t accX = toInt16(raw);
+  int32_t accY = toInt16(raw + 2);
+  int32_t accZ = toInt16(raw + 4);
+  uint32_t magnitude = isqrt((uint32_t)(accY * accY) + (uint32_t)(accZ * accZ));
+  return -atan2Milli(accX, magnitude);
+}
+
+// Tilt around the Y axis in millidegrees, from a single accelerometer sample
+int32_t readTiltY()
+{
+  uint8_t raw[6];
+  if (readRegisters(REG_ACCEL_XOUT_H, raw, sizeof(raw)) != sizeof(raw)) {
+    return 0;
+  }
+  return accelTiltY(raw);
+}
+
+// Apply up/down hysteresis, returns true if the orientation changed
+bool applyTilt(int32_t Y)
+{
+  uint8_t next = orientation;
 
-constexpr int8_t X_AXIS = 0;
-constexpr int8_t Y_AXIS = 1;
-constexpr int8_t Z_AXIS = 2;
+  if (Y >= orientationThreshold) {
+    next = ORIENTATION_UP;
+  } else if (Y <= -orientationThreshold) {
+    next = ORIENTATION_DOWN;
+  }  // in between: keep whatever we had
+
+  DebugPrintf("Tilt Y %d mdeg\n", Y);
+  if (next == orientation) return false;
+
+  orientation = next;
+  return true;
+}
+
+/**
+ * @brief Complementary filter step on one FIFO sample, all integer maths
+ */
+void filterSample(const uint8_t *sample)
+{
+  // gyro LSB -> hundredths of a micro degree per sample
+  constexpr int32_t scale = 1000000000L / (gyroLsbPerDps10 * trackingRate);
+  const int16_t *offset = settings::current.gyroOffset;
+
+  int32_t rateX = toInt16(sample + 6) - offset[0];
+  int32_t rateY = toInt16(sample + 8) - offset[1];
+
+  angleX += rateX * scale / 100;
+  angleY += rateY * scale / 100;
+  angleX += (accelTiltX(sample) * 1000 - angleX) / filterAccelShare;
+  angleY += (accelTiltY(sample) * 1000 - angleY) / filterAccelShare;
+  samplesFiltered++;
+}
+
+uint16_t fifoCount()
+{
+  uint8_t raw[2];
+  if (readRegisters(REG_FIFO_COUNT_H, raw, sizeof(raw)) != sizeof(raw)) {
+    return 0;
+  }
+  return raw[0] << 8 | raw[1];
+}
+
+void fifoReset()
+{
+  writeRegister(REG_USER_CTRL, 0x04);  // FIFO_RESET
+  writeRegister(REG_USER_CTRL, 0x40);  // FIFO_EN
+}
+
+/**
+ * @brief Drain whole samples from the FIFO, fifoBurstSamples per I2C
+ * transaction, handing each to the callback
+ *
+ * @return number of samples read
+ */
+template <typename Callback>
+uint16_t fifoDrain(Callback callback)
+{
+  uint8_t buf[fifoSampleSize * fifoBurstSamples];
+
+  if (readRegister(REG_INT_STATUS) & INT_FIFO_OFLOW) {
+    DebugPrintln("*IMU: FIFO overflow");
+    fifoReset();
+    return 0;
+  }
 
+  uint16_t samples = fifoCount() / fifoSampleSize;
+  uint16_t done = 0;
+  while (done < samples) {
+    uint8_t burst = min<uint16_t>(samples - done, fifoBurstSamples);
+    uint8_t len = burst * fifoSampleSize;
+    if (readRegisters(REG_FIFO_R_W, buf, len) != len) break;
+
+    for (uint8_t i = 0; i < burst; i++) callback(buf + i * fifoSampleSize);
+    done += burst;
+  }
+  return done;
+}
+
+void enterLowPowerMode()
+{
+  writeRegister(REG_USER_CTRL, 0x00);  // FIFO off
+  writeRegister(REG_FIFO_EN, 0x00);
+  writeRegister(REG_PWR_MGMT_1, 0x00);    // wake up, internal oscillator
+  writeRegister(REG_ACCEL_CONFIG, 0x01);  // +/-2g, 5Hz high pass for motion
+  writeRegister(REG_MOT_THR, motionThreshold);
+  writeRegister(REG_MOT_DUR, motionDuration);
+  writeRegister(REG_INT_PIN_CFG, 0x30);  // active high, latched, clear on read
+  writeRegister(REG_INT_ENABLE, 0x40);   // motion interrupt only
+  writeRegister(REG_PWR_MGMT_2, 0x47);   // 5Hz wake cycle, gyros in standby
+  writeRegister(REG_PWR_MGMT_1, 0x28);   // cycle mode, temp sensor off
+}
+
+/**
+ * @brief Switch to full power with accel + gyro streaming into the FIFO.
+ * The motion interrupt stays armed so settling is still detected.
+ */
+void startTracking()
+{
+  if (!useIMU || tracking) return;
+
+  writeRegister(REG_PWR_MGMT_1, 0x01);   // awake, gyro X PLL clock
+  writeRegister(REG_PWR_MGMT_2, 0x00);   // everything on
+  writeRegister(REG_CONFIG, 0x03);       // 44Hz DLPF, 1kHz internal rate
+  writeRegister(REG_SMPLRT_DIV, 1000 / trackingRate - 1);
+  writeRegister(REG_GYRO_CONFIG, 0x08);  // +/-500dps
+  writeRegister(REG_FIFO_EN, 0x78);      // accel + gyro XYZ
+  fifoReset();
+
+  // seed the filter from the accelerometer so it doesn't have to converge
+  uint8_t raw[6];
+  if (readRegisters(REG_ACCEL_XOUT_H, raw, sizeof(raw)) == sizeof(raw)) {
+    angleX = accelTiltX(raw) * 1000;
+    angleY = accelTiltY(raw) * 1000;
+  }
+  tracking = true;
+}
+
+void stopTracking()
+{
+  if (!tracking) return;
+  tracking = false;
+  enterLowPowerMode();
+}
+
+void trackingUpdate()
+{
+  if (tracking) fifoDrain(filterSample);
+}
+
+/**
+ * @brief Average the gyro zero rate over gyroCalibrationSamples while the
+ * clock is still, and persist it so this only has to happen once
+ */
+void calibrateGyro()
+{
+  if (!useIMU) return;
+
+  bool wasTracking = tracking;
+  startTracking();
+
+  int32_t sum[3] = {0, 0, 0};
+  uint16_t count = 0;
+  uint32_t start = millis();
+  while (count < gyroCalibrationSamples && millis() - start < 3000) {
+    delay(1000 / trackingRate * fifoBurstSamples);
+    fifoDrain([&](const uint8_t *sample) {
+      if (count >= gyroCalibrationSamples) return;
+      for (uint8_t axis = 0; axis < 3; axis++) {
+        sum[axis] += toInt16(sample + 6 + axis * 2);
+      }
+      count++;
+    });
+  }
+
+  if (count) {
+    for (uint8_t axis = 0; axis < 3; axis++) {
+      settings::current.gyroOffset[axis] = sum[axis] / count;
+    }
+    settings::current.gyroCalibrated = true;
+    settings::save();
+    DebugPrintf("*IMU: gyro offsets %d, %d, %d\n",
+                settings::current.gyroOffset[0],
+                settings::current.gyroOffset[1],
+                settings::current.gyroOffset[2]);
+  }
+
+  if (!wasTracking) stopTracking();
+}
+
+void pushGesture(Gesture gesture)
+{
+  if (gestureCount < gestureQueueSize) gestureQueue[gestureCount++] = gesture;
+}
+
+// Turn pending clicks into a gesture once no further click can follow
+void flushClicks(uint32_t time)
+{
+  if (clicks && stableLevel == HIGH && time - releaseTime > doubleClickGap) {
+    pushGesture(clicks == 1 ? GESTURE_SINGLE : GESTURE_DOUBLE);
+    clicks = 0;
+  }
+}
+
+void checkLongPress(uint32_t time)
+{
+  if (stableLevel == LOW && !longFired && time - pressTime >= longPressTime) {
+    pushGesture(GESTURE_LONG);
+    longFired = true;
+    clicks = 0;
+  }
+}
+
+// Debounced level change at the time the level first appeared
+void buttonTransition(uint8_t level, uint32_t time)
+{
+  flushClicks(time);
+  checkLongPress(time);
+  stableLevel = level;
+
+  if (level == LOW) {
+    pressTime = time;
+    longFired = false;
+  } else if (!longFired) {
+    releaseTime = time;
+    if (++clicks == 2) {
+      pushGesture(GESTURE_DOUBLE);
+      clicks = 0;
+    }
+  }
+}
+
+// Commit the raw level if it has been stable for debounceTime before time
+void debounceUntil(uint32_t time)
+{
+  if (rawLevel != stableLevel && time - rawTime >= debounceTime) {
+    buttonTransition(rawLevel, rawTime);
+  }
+}
+
+/**
+ * @brief Decode queued button edges into gestures. Edges carry their own
+ * timestamps, so presses made while the loop was busy still decode correctly.
+ */
+void buttonUpdate()
+{
+  while (edgeTail != edgeHead) {
+    uint8_t tail = edgeTail;
+    uint32_t time = edgeQueue[tail].time;
+    uint8_t level = edgeQueue[tail].level;
+    edgeTail = (tail + 1) & (edgeQueueSize - 1);
+
+    debounceUntil(time);
+    rawLevel = level;
+    rawTime = time;
+  }
+
+  uint32_t now = millis();
+  debounceUntil(now);
+  checkLongPress(now);
+  flushClicks(now);
+}
+
+/**
+ * @brief Next decoded button gesture, or GESTURE_NONE
+ */
+Gesture buttonGesture()
+{
+  buttonUpdate();
+  if (!gestureCount) return GESTURE_NONE;
+
+  Gesture gesture = gestureQueue[0];
+  gestureCount--;
+  memmove(gestureQueue, gestureQueue + 1, gestureCount * sizeof(Gesture));
+  return gesture;
+}
+
+void initButton()
+{
+  pinMode(BUTTON_PIN, INPUT_PULLUP);
+  stableLevel = rawLevel = digitalRead(BUTTON_PIN);
+  attachInterrupt(digitalPinToInterrupt(BUTTON_PIN), buttonISR, CHANGE);
+}
+
+/**
+ * @brief Put the MPU6050 into low power accelerometer-only cycle mode with a
+ * motion interrupt on MPU_INT_PIN, then take an initial orientation reading
+ *
+ * @param calcOffsets force gyro calibration even if offsets are stored
+ */
 void initGyro(bool calcOffsets = false)
 {
   if (!useIMU) return;
@@ -27,28 +511,67 @@ void initGyro(bool calcOffsets = false)
   Wire.begin(D2, D1);  // SDA, SCL
 #endif
 
-  mpu6050.begin();
-  if (calcOffsets) mpu6050.calcGyroOffsets(false, 100, 100);
+  if (readRegister(REG_WHO_AM_I) != MPU6050_ADDR) {
+    DebugPrintln("*IMU: MPU6050 not found");
+    useIMU = false;
+    return;
+  }
+
+  if (calcOffsets || !settings::current.gyroCalibrated) calibrateGyro();
+
+  enterLowPowerMode();
+  readRegister(REG_INT_STATUS);  // clear anything latched during setup
+  pinMode(MPU_INT_PIN, INPUT);  // take it back from SPI (MISO), see globals.h
+  attachInterrupt(digitalPinToInterrupt(MPU_INT_PIN), motionISR, RISING);
+
+  applyTilt(readTiltY());
 }
 
-void gyroUpdate()
+/**
+ * @brief Track motion through the FIFO while the clock is being moved, and
+ * re-evaluate orientation from the filtered tilt once it has settled
+ *
+ * @return true if the orientation changed
+ */
+bool orientationUpdate()
 {
-  if (useIMU) mpu6050.update();
+  if (!useIMU) return false;
+
+  if (motionDetected) {
+    motionDetected = false;
+    readRegister(REG_INT_STATUS);  // re-arm latched interrupt
+    lastMotion = millis();
+    orientationPending = true;
+    startTracking();
+  }
+
+  if (!orientationPending) return false;
+
+  trackingUpdate();
+  if ((millis() - lastMotion) < motionSettleTime) return false;
+
+  orientationPending = false;
+  int32_t tilt = angleY / 1000;
+  stopTracking();
+  return applyTilt(tilt);
 }
 
-float gyroGetValue(int axis = Y_AXIS, bool multipleReadings = false)
+/**
+ * @brief Disarm the motion interrupt and stop any tracking while an update
+ * is being received, and re-arm it afterwards
+ */
+void pause(bool paused)
 {
-  if (!useIMU) return 0;
+  if (!useIMU) return;
 
-  if (multipleReadings) {
-    for (int i = 0; i < 10; i++) {
-      sensor::gyroUpdate();
-      delay(5);
-    }
+  if (paused) {
+    detachInterrupt(digitalPinToInterrupt(MPU_INT_PIN));
+    motionDetected = false;
+    orientationPending = false;
+    stopTracking();
+  } else {
+    readRegister(REG_INT_STATUS);  // drop motion latched while paused
+    attachInterrupt(digitalPinToInterrupt(MPU_INT_PIN), motionISR, RISING);
   }
-  if (axis == X_AXIS) return mpu6050.getAngleX();
-  if (axis == Y_AXIS) return mpu6050.getAngleY();
-  if (axis == Z_AXIS) return mpu6050.getAngleZ();
-  return 0;
 }
-}  // namespace sensor
\ No newline at end of file
+}  // namespace sensor
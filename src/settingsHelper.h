@@ -0,0 +1,81 @@
+#pragma once
+
+#include <EEPROM.h>   // Emulated EEPROM in flash
+#include <globals.h>  // Global libraries and variables
+
+namespace settings
+{
+constexpr uint32_t MAGIC = 0x4E545043;  // "NTPC"
+constexpr uint16_t LAYOUT = 5;          // Bump when the layout changes
+constexpr uint8_t scheduleSize = 8;     // Scheduled action slots
+
+// One scheduled action, run at a local time of day on chosen weekdays
+struct ScheduleRule {
+  uint8_t action;  // schedule::Action, ACTION_NONE for an unused slot
+  uint8_t hour;    // Local time of day
+  uint8_t minute;
+  uint8_t days;   // Weekday mask, bit 0 = Sunday
+  uint8_t value;  // Intensity for schedule::ACTION_INTENSITY
+  char text[19];  // Message for schedule::ACTION_REMINDER
+};
+
+// Persistent settings, stored as a single block in emulated EEPROM
+struct Settings {
+  uint32_t magic;
+  uint16_t version;
+  bool gyroCalibrated;    // gyroOffset holds a valid calibration
+  int16_t gyroOffset[3];  // Raw gyro zero rate offsets (X, Y, Z)
+  uint8_t powerMode;      // sleep::PowerMode
+  char timezone[48];      // POSIX TZ string
+  bool beacon;            // Take part in the LAN time beacon
+  ScheduleRule schedule[scheduleSize];
+  uint32_t checksum;      // Must stay last
+};
+
+Settings current;
+
+uint32_t checksum(const Settings &s)
+{
+  // FNV-1a over everything except the checksum itself
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(&s);
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < offsetof(Settings, checksum); i++) {
+    hash = (hash ^ p[i]) * 16777619UL;
+  }
+  return hash;
+}
+
+void setDefaults()
+{
+  memset(&current, 0, sizeof(current));
+  current.magic = MAGIC;
+  current.version = LAYOUT;
+  strlcpy(current.timezone, defaultTimezone, sizeof(current.timezone));
+}
+
+/**
+ * @brief Load settings from flash, falling back to defaults if the stored
+ * block is missing, from another version or corrupt
+ */
+void load()
+{
+  EEPROM.begin(sizeof(Settings));
+  EEPROM.get(0, current);
+
+  if (current.magic != MAGIC || current.version != LAYOUT ||
+      current.checksum != checksum(current)) {
+    DebugPrintln("*Settings: none stored, using defaults");
+    setDefaults();
+  }
+}
+
+/**
+ * @brief Write current settings to flash (only if they changed)
+ */
+bool save()
+{
+  current.checksum = checksum(current);
+  EEPROM.put(0, current);
+  return EEPROM.commit();
+}
+}  // namespace settings
@@ -1,10 +1,21 @@
 #pragma once
 
 #include <ESP8266WiFi.h>  // ESP8266 Core WiFi Library
+#include <coredecls.h>    // esp_delay(), esp_schedule()
 #include <globals.h>      // Global libraries and variables
+#include <timeHelper.h>   // Time keeping
 
 namespace sleep
 {
+volatile bool wakeRequested = false;  // Set from interrupts to cut sleep short
+
+// Hook for interrupt handlers: end the current SleepDelay() or low power
+// sleep early
+void IRAM_ATTR requestWake()
+{
+  wakeRequested = true;
+  esp_schedule();  // resume a suspended esp_delay()
+}
 
 /*********************************************************************************************\
  * Sleep aware time scheduler functions borrowed from ESPEasy
@@ -46,7 +57,8 @@ void SetNextTimeInterval(uint32_t &timer, const uint32_t step)
   timer = millis() + (step - passed);
 }
 
-// Sleep for specified milliseconds unless data in UART buffer
+// Sleep for specified milliseconds unless data in UART buffer or a wake up
+// was requested by an interrupt
 void SleepDelay(uint32_t mseconds)
 {
   if (mseconds) {
@@ -56,10 +68,146 @@ void SleepDelay(uint32_t mseconds)
         break;
       }  // We need to service serial buffer ASAP as otherwise we get uart
          // buffer overrun
+      if (wakeRequested) {
+        break;
+      }  // Input event waiting to be handled
     }
   } else {
     delay(0);
   }
+  wakeRequested = false;
+}
+
+/*********************************************************************************************\
+ * Low power modes
+ *
+ * Modem and light sleep use the SDK's automatic (DTIM based) sleep, so the
+ * station stays associated and the web server / OTA remain reachable. Between
+ * clock ticks the loop blocks in a single esp_delay() so the SDK can power
+ * down, waking wakeGuard ms before the next second boundary of the time core,
+ * or at once when an interrupt calls requestWake(). Web requests don't wake
+ * it, so they can wait up to a second for the next tick to be served.
+\*********************************************************************************************/
+
+enum PowerMode : uint8_t { POWER_NORMAL, POWER_MODEM, POWER_LIGHT };
+
+constexpr uint8_t dtimListenInterval = 3;  // Wake for every 3rd DTIM beacon
+constexpr uint16_t wakeGuard = 15;         // ms to wake before next second
+constexpr uint32_t statsPeriod = 3600000;  // ms, current is reported per hour
+
+// Nominal ESP8266 supply current (uA) from the datasheet, used to turn the
+// measured awake / asleep split into a current estimate
+constexpr uint32_t currentActive = 70000;
+constexpr uint32_t currentModemSleep = 15000;
+constexpr uint32_t currentLightSleep = 900;
+
+struct PowerStats {
+  uint32_t awakeMs;        // Time spent running the loop this period
+  uint32_t asleepMs;       // Time spent in low power delay() this period
+  uint64_t charge;         // uA * ms consumed this period
+  uint32_t lastHourUa;     // Average current over the last full period
+  uint32_t wakes;          // Low power sleeps ended this period
+  uint32_t wakeLateSum;    // Sum of wake up overshoot, us
+  uint32_t wakeLateMax;    // Worst wake up overshoot, us
+  int32_t tickErrorMs;     // How late the loop saw the last second tick
+};
+
+PowerMode powerMode = POWER_NORMAL;
+PowerStats powerStats;
+
+const char *powerModeName(uint8_t mode)
+{
+  if (mode == POWER_MODEM) return "Modem sleep";
+  if (mode == POWER_LIGHT) return "Light sleep";
+  return "Normal";
+}
+
+void setPowerMode(uint8_t mode)
+{
+  powerMode = mode <= POWER_LIGHT ? (PowerMode)mode : POWER_NORMAL;
+
+  if (powerMode == POWER_LIGHT) {
+    WiFi.setSleepMode(WIFI_LIGHT_SLEEP, dtimListenInterval);
+  } else if (powerMode == POWER_MODEM) {
+    WiFi.setSleepMode(WIFI_MODEM_SLEEP, dtimListenInterval);
+  } else {
+    WiFi.setSleepMode(WIFI_NONE_SLEEP);
+  }
+  DebugPrintf("*Power: %s\n", powerModeName(powerMode));
+}
+
+// Called when the displayed second changes, to measure tick phase error
+void markSecondBoundary()
+{
+  powerStats.tickErrorMs = timekeeping::utcMillis() % 1000;
+}
+
+void accountPower(uint32_t awakeMs, uint32_t asleepMs)
+{
+  uint32_t sleepCurrent =
+      powerMode == POWER_LIGHT ? currentLightSleep : currentModemSleep;
+
+  powerStats.awakeMs += awakeMs;
+  powerStats.asleepMs += asleepMs;
+  powerStats.charge += (uint64_t)awakeMs * currentActive +
+                       (uint64_t)asleepMs * sleepCurrent;
+
+  uint32_t total = powerStats.awakeMs + powerStats.asleepMs;
+  if (total >= statsPeriod) {
+    PowerStats next = {};
+    next.lastHourUa = powerStats.charge / total;
+    next.tickErrorMs = powerStats.tickErrorMs;
+    powerStats = next;
+  }
+}
+
+// Average current (uA) so far in the current period
+uint32_t currentEstimate()
+{
+  uint32_t total = powerStats.awakeMs + powerStats.asleepMs;
+  return total ? powerStats.charge / total : currentActive;
+}
+
+uint32_t averageWakeLatency()
+{
+  return powerStats.wakes ? powerStats.wakeLateSum / powerStats.wakes : 0;
+}
+
+/**
+ * @brief Sleep until just before the next second boundary, then the rest of
+ * the way in 1ms steps so the tick lands on time
+ */
+void lowPowerSleep(uint32_t my_activity)
+{
+  if (!timekeeping::isSet()) {
+    // clock not ticking yet - plain loop cadence
+    SleepDelay(sleepTime);
+    accountPower(my_activity, 0);
+    return;
+  }
+
+  uint32_t untilTick = timekeeping::msUntilNextSecond();
+  if (untilTick <= wakeGuard) {
+    SleepDelay(untilTick);  // tick imminent
+    accountPower(my_activity + untilTick, 0);
+    return;
+  }
+
+  uint32_t duration = untilTick - wakeGuard;
+  uint32_t start = micros();
+  // one long wait so the SDK can sleep the modem / CPU, cut short by
+  // requestWake()
+  esp_delay(duration, []() { return !wakeRequested; });
+  uint32_t slept = micros() - start;
+
+  if (!wakeRequested) {  // early wakes aren't overshoot
+    uint32_t late = slept > duration * 1000 ? slept - duration * 1000 : 0;
+    powerStats.wakes++;
+    powerStats.wakeLateSum += late;
+    powerStats.wakeLateMax = max(powerStats.wakeLateMax, late);
+  }
+  accountPower(my_activity, slept / 1000);
+  wakeRequested = false;
 }
 
 void dynamicSleep(uint32_t my_sleep)
@@ -67,9 +215,15 @@ void dynamicSleep(uint32_t my_sleep)
   // Dynamic sleep
   uint32_t my_activity =
       millis() - my_sleep;  // Time this loop has taken in milliseconds
-  if (my_activity < sleepTime) {
-    SleepDelay(sleepTime -
-               my_activity);  // Provide time for background tasks like wifi
+  if (powerMode != POWER_NORMAL && WiFi.status() == WL_CONNECTED) {
+    lowPowerSleep(my_activity);
+  } else if (my_activity < sleepTime) {
+    uint32_t wait = sleepTime - my_activity;
+    // wake on the second boundary rather than up to a loop period after it
+    if (timekeeping::isSet()) {
+      wait = min<uint32_t>(wait, timekeeping::msUntilNextSecond());
+    }
+    SleepDelay(wait);  // Provide time for background tasks like wifi
   } else {
     if (WiFi.status() != WL_CONNECTED) {
       SleepDelay(my_activity / 2);  // If wifi down then force loop delay to 1/2
@@ -93,13 +247,4 @@ void dynamicSleep(uint32_t my_sleep)
       (this_cycle_ratio / loops_per_second);  // Take away one loop average away
                                               // and add the new one
 }
-
-void updateUptime()
-{
-  static uint32_t state_second = 0;  // State second timer
-  if (TimeReached(state_second)) {
-    SetNextTimeInterval(state_second, 1000);
-    uptime++;
-  }
-}
 }  // namespace sleep
\ No newline at end of file
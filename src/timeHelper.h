@@ -0,0 +1,424 @@
+#pragma once
+
+#include <globals.h>  // Global libraries and variables
+#include <ctype.h>    // isalpha, isdigit
+#include <time.h>     // time_t
+
+namespace timekeeping
+{
+constexpr int32_t SECS_PER_MIN = 60;
+constexpr int32_t SECS_PER_HOUR = 3600;
+constexpr int32_t SECS_PER_DAY = 86400;
+
+// Local date / time fields for one second, shared by every consumer
+struct DateTime {
+  time_t epoch;     // Local seconds since 1970 these fields describe
+  uint16_t year;    // e.g. 2024
+  uint8_t month;    // 1 - 12
+  uint8_t day;      // 1 - 31
+  uint8_t weekday;  // 0 = Sunday
+  uint8_t hour;     // 0 - 23
+  uint8_t hour12;   // 1 - 12
+  uint8_t minute;   // 0 - 59
+  uint8_t second;   // 0 - 59
+  bool isAM;
+  bool isDst;  // Daylight saving time in effect
+};
+
+// One rule of a POSIX TZ string: Mm.w.d, Jn or n, plus /time
+struct TzRule {
+  char type;        // 'M', 'J' or 'n'
+  uint8_t month;    // M: 1 - 12
+  uint8_t week;     // M: 1 - 5, 5 = last
+  uint8_t weekday;  // M: 0 = Sunday
+  uint16_t day;     // J: 1 - 365, n: 0 - 365
+  int32_t time;     // Seconds after local midnight, default 02:00
+};
+
+// Time zone parsed from a POSIX TZ string, e.g. "AEST-10AEDT,M10.1.0,M4.1.0/3"
+struct TimeZone {
+  char stdName[8];
+  char dstName[8];
+  int32_t stdOffset;  // Seconds added to UTC in standard time
+  int32_t dstOffset;  // Seconds added to UTC in daylight saving time
+  bool hasDst;
+  TzRule start;  // Daylight saving starts (in standard time)
+  TzRule end;    // Daylight saving ends (in daylight saving time)
+};
+
+// A precomputed instant at which the UTC offset changes
+struct Transition {
+  time_t utc;
+  bool dst;  // Daylight saving in effect from this instant
+};
+
+constexpr uint8_t transitionYears = 4;  // Years of transitions precomputed
+
+DateTime local;  // Refreshed by tick() once per second
+
+TimeZone zone;
+Transition transitions[transitionYears * 2];  // Sorted by utc
+uint8_t transitionCount = 0;
+time_t tableStart = 0;  // UTC range the transitions table covers
+time_t tableEnd = 0;
+time_t cacheFrom = 0;  // UTC range over which cachedDst holds
+time_t cacheUntil = 0;
+bool cachedDst = false;
+
+uint64_t monotonicHigh = 0;  // Upper 32 bits, counts millis() wraparounds
+uint32_t lastMillis = 0;     // millis() at the previous monotonicMillis()
+
+bool timeSet = false;     // utcOffsetMs is valid
+int64_t utcOffsetMs = 0;  // UTC epoch ms = monotonic ms + utcOffsetMs
+int32_t lastStepMs = 0;   // Correction applied by the last set
+time_t lastUtc = 0;       // UTC second local was last broken down for
+uint16_t zoneChanges = 0;  // Bumped by setZone(), for anything caching local times
+
+/**
+ * @brief Milliseconds since boot, carried past the 49.7 day millis() wrap.
+ * Must be called at least once per wrap period (the loop does).
+ */
+uint64_t monotonicMillis()
+{
+  uint32_t now = millis();
+  if (now < lastMillis) monotonicHigh += 1ULL << 32;
+  lastMillis = now;
+  return monotonicHigh | now;
+}
+
+bool isSet() { return timeSet; }
+
+uint64_t utcMillis() { return monotonicMillis() + utcOffsetMs; }
+
+time_t utcNow() { return utcMillis() / 1000; }
+
+// Milliseconds until the next UTC (and so local) second starts
+uint16_t msUntilNextSecond() { return 1000 - utcMillis() % 1000; }
+
+// Days since 1970-01-01 for a civil date (Howard Hinnant's algorithm)
+int32_t daysFromCivil(int32_t year, uint8_t month, uint8_t day)
+{
+  year -= month <= 2;
+  int32_t era = (year >= 0 ? year : year - 399) / 400;
+  uint32_t yoe = year - era * 400;
+  uint32_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int32_t)doe - 719468;
+}
+
+void breakTime(time_t epoch, DateTime &dt)
+{
+  int32_t days = epoch / SECS_PER_DAY;
+  uint32_t secs = epoch % SECS_PER_DAY;
+
+  // civil from days (Howard Hinnant's algorithm)
+  int32_t z = days + 719468;
+  int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+  uint32_t doe = z - era * 146097;
+  uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  uint32_t mp = (5 * doy + 2) / 153;
+
+  dt.epoch = epoch;
+  dt.day = doy - (153 * mp + 2) / 5 + 1;
+  dt.month = mp < 10 ? mp + 3 : mp - 9;
+  dt.year = yoe + era * 400 + (dt.month <= 2);
+  dt.weekday = (days + 4) % 7;  // 1970-01-01 was a Thursday
+  dt.hour = secs / SECS_PER_HOUR;
+  dt.minute = (secs / SECS_PER_MIN) % 60;
+  dt.second = secs % 60;
+  dt.isAM = dt.hour < 12;
+  dt.hour12 = dt.hour % 12 ? dt.hour % 12 : 12;
+}
+
+time_t makeTime(int year, int month, int day, int hour, int minute,
+                int second)
+{
+  return (time_t)daysFromCivil(year, month, day) * SECS_PER_DAY +
+         hour * SECS_PER_HOUR + minute * SECS_PER_MIN + second;
+}
+
+bool isLeapYear(int32_t year)
+{
+  return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+uint8_t daysInMonth(int32_t year, uint8_t month)
+{
+  static const uint8_t days[] = {31, 28, 31, 30, 31, 30,
+                                 31, 31, 30, 31, 30, 31};
+  return month == 2 && isLeapYear(year) ? 29 : days[month - 1];
+}
+
+/*********************************************************************************************\
+ * POSIX TZ string parsing
+\*********************************************************************************************/
+
+bool parseName(const char *&p, char *name, size_t size)
+{
+  size_t len = 0;
+  bool quoted = *p == '<';
+  if (quoted) p++;
+
+  // quoted names may also hold digits and signs, nothing else
+  while (quoted ? isalnum(*p) || *p == '+' || *p == '-' : isalpha(*p)) {
+    if (len < size - 1) name[len++] = *p;
+    p++;
+  }
+  if (quoted && *p++ != '>') return false;
+
+  name[len] = '\0';
+  return len > 0;
+}
+
+// [+|-]hh[:mm[:ss]] in seconds
+bool parseTime(const char *&p, int32_t &secs)
+{
+  int32_t sign = 1;
+  if (*p == '+' || *p == '-') sign = *p++ == '-' ? -1 : 1;
+  if (!isdigit(*p)) return false;
+
+  int32_t parts[3] = {0, 0, 0};
+  for (uint8_t i = 0; i < 3; i++) {
+    while (isdigit(*p)) parts[i] = parts[i] * 10 + (*p++ - '0');
+    if (*p != ':' || i == 2) break;
+    p++;
+  }
+  secs = sign * (parts[0] * SECS_PER_HOUR + parts[1] * SECS_PER_MIN + parts[2]);
+  return true;
+}
+
+uint16_t parseNumber(const char *&p)
+{
+  uint16_t n = 0;
+  while (isdigit(*p)) n = n * 10 + (*p++ - '0');
+  return n;
+}
+
+bool parseRule(const char *&p, TzRule &rule)
+{
+  if (*p++ != ',') return false;
+
+  if (*p == 'M') {
+    p++;
+    rule.type = 'M';
+    rule.month = parseNumber(p);
+    if (*p++ != '.') return false;
+    rule.week = parseNumber(p);
+    if (*p++ != '.') return false;
+    rule.weekday = parseNumber(p);
+    if (rule.month < 1 || rule.month > 12 || rule.week < 1 ||
+        rule.week > 5 || rule.weekday > 6) {
+      return false;
+    }
+  } else if (*p == 'J') {
+    p++;
+    rule.type = 'J';
+    rule.day = parseNumber(p);
+    if (rule.day < 1 || rule.day > 365) return false;
+  } else if (isdigit(*p)) {
+    rule.type = 'n';
+    rule.day = parseNumber(p);
+    if (rule.day > 365) return false;
+  } else {
+    return false;
+  }
+
+  rule.time = 2 * SECS_PER_HOUR;
+  if (*p == '/') return parseTime(++p, rule.time);
+  return true;
+}
+
+/**
+ * @brief Parse a POSIX TZ string such as "AEST-10AEDT,M10.1.0,M4.1.0/3".
+ * Note POSIX offsets are west of UTC, so AEST-10 is UTC+10.
+ */
+bool parseTimeZone(const char *p, TimeZone &tz)
+{
+  int32_t offset;
+
+  memset(&tz, 0, sizeof(tz));
+  if (!parseName(p, tz.stdName, sizeof(tz.stdName))) return false;
+  if (!parseTime(p, offset)) return false;
+  tz.stdOffset = -offset;
+  tz.dstOffset = tz.stdOffset;
+
+  if (!*p) return true;  // no daylight saving
+
+  if (!parseName(p, tz.dstName, sizeof(tz.dstName))) return false;
+  tz.dstOffset = tz.stdOffset + SECS_PER_HOUR;
+  if (*p && *p != ',') {
+    if (!parseTime(p, offset)) return false;
+    tz.dstOffset = -offset;
+  }
+
+  // no rules given: fall back to the current US rules, like glibc
+  if (!*p) p = ",M3.2.0,M11.1.0";
+
+  tz.hasDst = parseRule(p, tz.start) && parseRule(p, tz.end) && !*p;
+  return tz.hasDst;
+}
+
+/*********************************************************************************************\
+ * Transition table
+\*********************************************************************************************/
+
+// Local time (seconds since 1970) at which a rule fires in the given year
+time_t ruleTime(const TzRule &rule, int32_t year)
+{
+  int32_t days;
+
+  if (rule.type == 'M') {
+    days = daysFromCivil(year, rule.month, 1);
+    uint8_t firstWeekday = (days + 4) % 7;
+    int32_t day = 1 + (rule.weekday - firstWeekday + 7) % 7 +
+                  (rule.week - 1) * 7;
+    while (day > daysInMonth(year, rule.month)) day -= 7;  // week 5 = last
+    days += day - 1;
+  } else if (rule.type == 'J') {
+    // Julian day 1 - 365, February 29th is never counted
+    days = daysFromCivil(year, 1, 1) + rule.day - 1 +
+           (isLeapYear(year) && rule.day >= 60);
+  } else {
+    days = daysFromCivil(year, 1, 1) + rule.day;
+  }
+  return (time_t)days * SECS_PER_DAY + rule.time;
+}
+
+/**
+ * @brief Precompute transitionYears years of transitions from firstYear into
+ * a small table sorted by UTC instant
+ */
+void buildTransitions(int32_t firstYear)
+{
+  transitionCount = 0;
+  for (int32_t year = firstYear; year < firstYear + transitionYears; year++) {
+    Transition start = {ruleTime(zone.start, year) - zone.stdOffset, true};
+    Transition end = {ruleTime(zone.end, year) - zone.dstOffset, false};
+
+    for (const Transition &t : {start, end}) {
+      uint8_t i = transitionCount++;
+      while (i && transitions[i - 1].utc > t.utc) {
+        transitions[i] = transitions[i - 1];
+        i--;
+      }
+      transitions[i] = t;
+    }
+  }
+
+  tableStart = makeTime(firstYear, 1, 1, 0, 0, 0) - zone.stdOffset;
+  tableEnd = makeTime(firstYear + transitionYears, 1, 1, 0, 0, 0) -
+             zone.stdOffset;
+  cacheFrom = cacheUntil = 0;
+}
+
+/**
+ * @brief Whether daylight saving is in effect at a UTC instant. Normally a
+ * range check against the cached interval; the table is searched only when
+ * a transition is crossed, and rebuilt only when its years run out.
+ */
+bool isDstAt(time_t utc)
+{
+  if (!zone.hasDst) return false;
+  if (utc >= cacheFrom && utc < cacheUntil) return cachedDst;
+
+  if (utc < tableStart || utc >= tableEnd) {
+    DateTime dt;
+    breakTime(utc + zone.stdOffset, dt);
+    buildTransitions(dt.year - 1);
+  }
+
+  uint8_t next = 0;
+  while (next < transitionCount && transitions[next].utc <= utc) next++;
+
+  cachedDst = next ? transitions[next - 1].dst : !transitions[0].dst;
+  cacheFrom = next ? transitions[next - 1].utc : tableStart;
+  cacheUntil = next < transitionCount ? transitions[next].utc : tableEnd;
+  return cachedDst;
+}
+
+int32_t utcOffsetAt(time_t utc)
+{
+  return isDstAt(utc) ? zone.dstOffset : zone.stdOffset;
+}
+
+time_t toLocal(time_t utc) { return utc + utcOffsetAt(utc); }
+
+// Local to UTC; ambiguous / skipped local times resolve to standard time
+time_t toUtc(time_t localTime)
+{
+  time_t standard = localTime - zone.stdOffset;
+  if (toLocal(standard) == localTime) return standard;
+  time_t daylight = localTime - zone.dstOffset;
+  return toLocal(daylight) == localTime ? daylight : standard;
+}
+
+/**
+ * @brief Switch to the zone described by a POSIX TZ string
+ *
+ * @return false (zone unchanged) if the string could not be parsed
+ */
+bool setZone(const char *tz)
+{
+  TimeZone parsed;
+  if (!parseTimeZone(tz, parsed)) {
+    DebugPrintf("*Time: invalid zone '%s'\n", tz);
+    return false;
+  }
+
+  zone = parsed;
+  tableStart = tableEnd = 0;  // rebuild on next lookup
+  cacheFrom = cacheUntil = 0;
+  lastUtc = 0;  // re-break local time on the next tick
+  zoneChanges++;
+  return true;
+}
+
+/**
+ * @brief Discipline the clock: utcMs was the UTC time when the monotonic
+ * counter read atMonotonic
+ */
+void setUtcMillis(uint64_t utcMs, uint64_t atMonotonic)
+{
+  int64_t offset = (int64_t)(utcMs - atMonotonic);
+  lastStepMs = timeSet ? offset - utcOffsetMs : 0;
+  utcOffsetMs = offset;
+  timeSet = true;
+  lastUtc = 0;  // force a fresh breakdown on the next tick
+}
+
+/**
+ * @brief Nudge the clock by a few ms (LAN phase lock), without the forced
+ * re-breakdown a set does. A nudge back across a second boundary doesn't
+ * redraw the earlier second; tick() just waits for the next one.
+ */
+void adjustMillis(int32_t deltaMs) { utcOffsetMs += deltaMs; }
+
+void setLocal(int year, int month, int day, int hour, int minute, int second)
+{
+  time_t utc = toUtc(makeTime(year, month, day, hour, minute, second));
+  setUtcMillis((uint64_t)utc * 1000, monotonicMillis());
+}
+
+/**
+ * @brief Advance the time core, call once per loop. Updates uptime and, when
+ * the second changes, breaks local time down into `local` exactly once.
+ *
+ * @return true if a new second started (local was refreshed)
+ */
+bool tick()
+{
+  uptime = monotonicMillis() / 1000;
+  if (!timeSet) return false;
+
+  // lastUtc is cleared by every set, so only an adjustMillis() nudge can
+  // take utc behind it
+  time_t utc = utcNow();
+  if (utc <= lastUtc) return false;
+
+  lastUtc = utc;
+  local.isDst = isDstAt(utc);
+  breakTime(utc + (local.isDst ? zone.dstOffset : zone.stdOffset), local);
+  return true;
+}
+}  // namespace timekeeping
@@ -86,6 +86,8 @@ constexpr char info[] PROGMEM = R"=====(
 <b>Reset Reason:</b> %ESP.getResetReason%<br />
 <br />
 <b>Load Average:</b> %loop_load_avg%<br />
+<b>Power Mode:</b> %powerMode% (%awakePercent%% awake, ~%currentEstimate% mA, last hour ~%lastHourCurrent% mA)<br />
+<b>Wake Latency:</b> %wakeLatencyAvg% us average, %wakeLatencyMax% us worst, tick error %tickError% ms<br />
 <b>Free Heap:</b> %ESP.getFreeHeap% bytes (%ESP.getHeapFragmentation%% fragmentation)<br />
 <br />
 <b>ESP8266 Chip ID:</b> %ESP.getChipId%<br />
@@ -98,14 +100,20 @@ constexpr char info[] PROGMEM = R"=====(
 <b>WiFi SSID:</b> %WiFi.SSID%<br />
 <b>WiFi RSSI:</b> %WiFi.RSSI%dBm<br />
 <b>WiFi IP:</b> %WiFi.localIP%<br />
+<b>LAN Beacon:</b> %beaconState%<br />
 <br />
 <b>System Uptime:</b> %systemUpTimeDy% day(s), %systemUpTimeHr% hour(s), %systemUpTimeMn% minute(s), %systemUpTimeSc% second(s)<br />
 <b>Uptime (seconds):</b> %uptime%<br />
+<b>Event Journal:</b> %journalRecords% records, boot %journalBoot%<br />
 <br /><br />
 <a href="/restart"><button>Restart</button></a>
 <br /><br />
 <a href="/resetWifi"><button>Erase WiFi Credentials</button></a>
 <br /><br />
+<a href="/ntp"><button>NTP History</button></a>
+<br /><br />
+<a href="/journal.csv"><button>Download Event Journal</button></a>
+<br /><br />
 <a href="/"><button>Back</button></a>
 )=====";
 
@@ -123,5 +131,111 @@ constexpr char htmlConfig[] PROGMEM = R"=====(
  <input type="submit" value="Save" />
  </form>
  <br />
+<form action="/configSave">
+<label for="timezone">Time zone (POSIX TZ string, e.g. AEST-10AEDT,M10.1.0,M4.1.0/3):</label>
+<input type="text" id="timezone" name="timezone" value="%TIMEZONE%" maxlength="47" />
+ <br /><br />
+<label for="power-mode">Power mode:</label>
+<select id="power-mode" name="power-mode">
+  <option value="0"%POWER_MODE_0%>Normal</option>
+  <option value="1"%POWER_MODE_1%>Modem sleep</option>
+  <option value="2"%POWER_MODE_2%>Light sleep</option>
+</select>
+<br /><small>In the sleep modes web pages can take up to a second to load.</small>
+ <br /><br />
+<label for="beacon">LAN time beacon (keep clocks on this network in step):</label>
+<select id="beacon" name="beacon">
+  <option value="0"%BEACON_0%>Off</option>
+  <option value="1"%BEACON_1%>On</option>
+</select>
+ <br /><br />
+ <input type="submit" value="Save" />
+ </form>
+ <br />
+<form action="/configSave">
+<b>Schedule</b> (local time; brightness 0 - 15 or reminder text in the last field):<br />
+%SCHEDULE%
+ <br />
+ <input type="submit" value="Save" />
+ </form>
+ <br />
  <a href="/"><button>Back</button></a>
 )=====";
+
+constexpr char htmlScheduleRow[] PROGMEM = R"=====(
+<select name="r%i%-action">%ACTIONS%</select>
+<input type="time" name="r%i%-time" value="%TIME%" style="width:auto" />
+<select name="r%i%-days">%DAYS%</select>
+<input type="text" name="r%i%-arg" value="%ARG%" maxlength="18" style="width:8em" />
+<br />
+)=====";
+
+constexpr char htmlNtp[] PROGMEM = R"=====(
+<b>Sync Attempts:</b> %ntpAttempts% (%ntpFailures% failed)<br />
+<b>Last Offset:</b> %ntpLastOffset% ms, largest %ntpMaxOffset% ms, jitter %ntpJitter% ms<br />
+<b>Round Trip:</b> %ntpDelayAvg% ms average, %ntpDelayMin% to %ntpDelayMax% ms<br />
+<b>Clock Drift:</b> %ntpDrift% ppm<br />
+<br />
+<b>Offset (ms)</b><br />
+<canvas id="offset" width="300" height="120"></canvas><br />
+<b>Round Trip (ms)</b><br />
+<canvas id="delay" width="300" height="120"></canvas><br />
+<small>Last %ntpHeld% attempts, failures marked in red</small>
+<br /><br />
+<a href="/ntp.csv"><button>Download CSV</button></a>
+<br /><br />
+<a href="/info"><button>Back</button></a>
+    <script>
+        // rows of /ntp.csv: time,uptime,server,offset_ms,delay_ms,stratum,result
+        function plot(id, rows, column) {
+            let canvas = document.getElementById(id);
+            let ctx = canvas.getContext("2d");
+            let w = canvas.width, h = canvas.height;
+            let values = rows.filter(r => r[6] == "ok").map(r => +r[column]);
+            let lo = Math.min(0, ...values);
+            let hi = Math.max(1, ...values);
+            let x = i => rows.length > 1 ? i * (w - 1) / (rows.length - 1) : w / 2;
+            let y = v => h - 1 - (v - lo) * (h - 12) / (hi - lo);
+
+            ctx.strokeStyle = "#ccc";
+            ctx.beginPath();
+            ctx.moveTo(0, y(0));
+            ctx.lineTo(w, y(0));
+            ctx.stroke();
+
+            ctx.fillStyle = "#c00";
+            ctx.strokeStyle = "#1fa3ec";
+            ctx.beginPath();
+            let started = false;
+            rows.forEach((r, i) => {
+                if (r[6] != "ok") {
+                    ctx.fillRect(x(i) - 1, 0, 2, h);
+                    return;
+                }
+                if (started) {
+                    ctx.lineTo(x(i), y(+r[column]));
+                } else {
+                    ctx.moveTo(x(i), y(+r[column]));
+                    started = true;
+                }
+            });
+            ctx.stroke();
+
+            ctx.fillStyle = "#000";
+            ctx.fillText(hi, 2, 10);
+            ctx.fillText(lo, 2, h - 2);
+        }
+
+        let history = new XMLHttpRequest();
+        history.onreadystatechange = function () {
+            if (this.readyState == 4 && this.status == 200) {
+                let rows = this.responseText.trim().split("\n").slice(1)
+                    .map(line => line.split(","));
+                plot("offset", rows, 3);
+                plot("delay", rows, 4);
+            }
+        };
+        history.open("GET", "/ntp.csv", true);
+        history.send();
+    </script>
+)=====";
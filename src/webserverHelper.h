@@ -1,7 +1,14 @@
 #pragma once
 
 #include <ESP8266WebServer.h>  // Local WebServer used to serve the configuration portal
+#include <beaconHelper.h>      // LAN time beacon
+#include <deltaHelper.h>       // Delta firmware updates
 #include <globals.h>           // Global libraries and variables
+#include <journalHelper.h>     // Persistent event journal
+#include <scheduleHelper.h>    // Scheduled actions
+#include <settingsHelper.h>    // Persistent settings
+#include <sleepHelper.h>       // Sleep helper functions
+#include <timeHelper.h>        // Time keeping
 #include <webserverHelper.h>  // Web server helper functions
 #include <wifiHelper.h>       // WiFi helper functions
 
@@ -12,6 +19,18 @@ namespace webserver
 ESP8266WebServer webserver(80);
 WiFiClient espClient;
 
+// Load figures reported by /stats, each covering the time since the last read
+uint32_t heapLowWater = UINT32_MAX;  // Least free heap seen
+int32_t tickErrorMax = 0;            // Worst second tick latency, ms
+uint32_t loopGapMax = 0;             // Longest time between loop passes, ms
+uint32_t lastLoop = 0;               // millis() of the previous loopTask()
+
+/**
+ * @brief Note the free heap; called while pages are held in memory, where
+ * use peaks, as well as once per loop
+ */
+void sampleHeap() { heapLowWater = min(heapLowWater, ESP.getFreeHeap()); }
+
 void notFound()
 {
   String message = "File Not Found\n\n";
@@ -43,13 +62,27 @@ void http_indexPage()
 
   html.replace("%DEVICE_NAME%", DEVICE_NAME);
 
+  sampleHeap();
   webserver.send(200, "text/html", html);
 }
 
+String beaconState()
+{
+  if (!beacon::enabled) return "off";
+  if (beacon::leading()) {
+    return "leading, " + String(beacon::sent) + " beacons sent";
+  }
+  if (beacon::following()) {
+    return "following " + String(beacon::leaderId, HEX) + ", last correction " +
+           String(beacon::lastOffset) + " ms";
+  }
+  return "listening";
+}
+
 void http_infoPage()
 {
   // calculate uptime
-  long millisecs = millis() / 1000;
+  uint32_t millisecs = timekeeping::monotonicMillis() / 1000;
   int systemUpTimeSc = millisecs % 60;
   int systemUpTimeMn = (millisecs / 60) % 60;
   int systemUpTimeHr = (millisecs / (60 * 60)) % 24;
@@ -78,6 +111,18 @@ void http_infoPage()
   html.replace("%ESP.getSdkVersion%", ESP.getSdkVersion());
   html.replace("%ESP.getResetReason%", ESP.getResetReason());
   html.replace("%loop_load_avg%", String(loop_load_avg));
+  uint32_t awakeMs = sleep::powerStats.awakeMs;
+  uint32_t totalMs = awakeMs + sleep::powerStats.asleepMs;
+  html.replace("%powerMode%", sleep::powerModeName(sleep::powerMode));
+  html.replace("%awakePercent%",
+               String(totalMs ? (uint32_t)(100ULL * awakeMs / totalMs) : 100));
+  html.replace("%currentEstimate%",
+               String(sleep::currentEstimate() / 1000.0, 1));
+  html.replace("%lastHourCurrent%",
+               String(sleep::powerStats.lastHourUa / 1000.0, 1));
+  html.replace("%wakeLatencyAvg%", String(sleep::averageWakeLatency()));
+  html.replace("%wakeLatencyMax%", String(sleep::powerStats.wakeLateMax));
+  html.replace("%tickError%", String(sleep::powerStats.tickErrorMs));
   html.replace("%ESP.getFreeHeap%", String(ESP.getFreeHeap()));
   html.replace("%ESP.getHeapFragmentation%",
                String(ESP.getHeapFragmentation()));
@@ -93,14 +138,118 @@ void http_infoPage()
   html.replace("%WiFi.SSID%", WiFi.SSID());
   html.replace("%WiFi.RSSI%", String(WiFi.RSSI()));
   html.replace("%WiFi.localIP%", WiFi.localIP().toString());
+  html.replace("%beaconState%", beaconState());
   html.replace("%systemUpTimeDy%", String(systemUpTimeDy));
   html.replace("%systemUpTimeHr%", String(systemUpTimeHr));
   html.replace("%systemUpTimeMn%", String(systemUpTimeMn));
   html.replace("%systemUpTimeSc%", String(systemUpTimeSc));
   html.replace("%uptime%", String(uptime));
+  html.replace("%journalRecords%", String(journal::recordCount()));
+  html.replace("%journalBoot%", String(journal::bootCount));
+  sampleHeap();
   webserver.send(200, "text/html", html);
 }
 
+/**
+ * @brief Escape text for use in HTML content and attribute values
+ */
+String htmlEscape(const char *text)
+{
+  String out;
+  for (; *text; text++) {
+    switch (*text) {
+      case '&': out += "&amp;"; break;
+      case '<': out += "&lt;"; break;
+      case '>': out += "&gt;"; break;
+      case '"': out += "&quot;"; break;
+      default: out += *text;
+    }
+  }
+  return out;
+}
+
+/**
+ * @brief Form fields for schedule slot i
+ */
+String scheduleRow(uint8_t i)
+{
+  const settings::ScheduleRule &rule = settings::current.schedule[i];
+  String row = FPSTR(htmlScheduleRow);
+
+  String actions;
+  for (uint8_t a = schedule::ACTION_NONE; a < schedule::ACTION_COUNT; a++) {
+    actions += "<option value=\"" + String(a) + "\"" +
+               (a == rule.action ? " selected>" : ">") +
+               schedule::actionName(a) + "</option>";
+  }
+
+  // presets, plus whatever else is stored so saving doesn't lose it
+  const uint8_t presets[] = {schedule::EVERY_DAY, schedule::WEEKDAYS,
+                             schedule::WEEKENDS};
+  const char *presetNames[] = {"Every day", "Weekdays", "Weekends"};
+  String days;
+  bool matched = false;
+  for (uint8_t p = 0; p < 3; p++) {
+    bool selected = rule.days == presets[p];
+    matched |= selected;
+    days += "<option value=\"" + String(presets[p]) + "\"" +
+            (selected ? " selected>" : ">") + presetNames[p] + "</option>";
+  }
+  if (!matched && rule.action != schedule::ACTION_NONE) {
+    days += "<option value=\"" + String(rule.days) +
+            "\" selected>Custom</option>";
+  }
+
+  char time[8];
+  snprintf(time, sizeof(time), "%02u:%02u", rule.hour, rule.minute);
+
+  row.replace("%i%", String(i));
+  row.replace("%ACTIONS%", actions);
+  row.replace("%TIME%", time);
+  row.replace("%DAYS%", days);
+  row.replace("%ARG%", rule.action == schedule::ACTION_INTENSITY
+                           ? String(rule.value)
+                           : String(rule.text));
+  return row;
+}
+
+/**
+ * @brief Read schedule slot i back from the /configSave arguments
+ */
+settings::ScheduleRule parseScheduleRow(uint8_t i)
+{
+  String prefix = "r" + String(i) + "-";
+  settings::ScheduleRule rule;
+  memset(&rule, 0, sizeof(rule));
+
+  int hour, minute;
+  rule.action = webserver.arg(prefix + "action").toInt();
+  if (rule.action >= schedule::ACTION_COUNT ||
+      sscanf(webserver.arg(prefix + "time").c_str(), "%d:%d", &hour,
+             &minute) != 2 ||
+      hour < 0 || hour > 23 || minute < 0 || minute > 59) {
+    rule.action = schedule::ACTION_NONE;
+  }
+  if (rule.action == schedule::ACTION_NONE) return rule;
+
+  rule.hour = hour;
+  rule.minute = minute;
+  rule.days = webserver.arg(prefix + "days").toInt() & schedule::EVERY_DAY;
+
+  const String arg = webserver.arg(prefix + "arg");
+  if (rule.action == schedule::ACTION_INTENSITY) {
+    rule.value = constrain(arg.toInt(), 0, 15);
+  } else if (rule.action == schedule::ACTION_REMINDER) {
+    // printable text only, and nothing that needs escaping in the form
+    uint8_t len = 0;
+    for (size_t c = 0; c < arg.length() && len < sizeof(rule.text) - 1; c++) {
+      char ch = arg[c];
+      if (ch >= ' ' && ch <= '~' && !strchr("\"<>&", ch)) rule.text[len++] = ch;
+    }
+  }
+  return rule;
+}
+
 /**
  * @brief Handle "/config" URL request
  */
@@ -115,6 +264,18 @@ void http_configPage()
   html += FPSTR(htmlFooter);
 
   html.replace("%DEVICE_NAME%", DEVICE_NAME);
+  html.replace("%TIMEZONE%", htmlEscape(settings::current.timezone));
+  String rows;
+  for (uint8_t i = 0; i < settings::scheduleSize; i++) rows += scheduleRow(i);
+  html.replace("%SCHEDULE%", rows);
+  for (uint8_t mode = sleep::POWER_NORMAL; mode <= sleep::POWER_LIGHT;
+       mode++) {
+    html.replace("%POWER_MODE_" + String(mode) + "%",
+                 mode == sleep::powerMode ? " selected" : "");
+  }
+  html.replace("%BEACON_0%", beacon::enabled ? "" : " selected");
+  html.replace("%BEACON_1%", beacon::enabled ? " selected" : "");
+  sampleHeap();
   webserver.send(200, "text/html", html);
 }
 /**
@@ -123,6 +284,10 @@ void http_configPage()
 void http_configPageSave()
 {
   String statusMsg;
+  auto status = [&statusMsg](const char *msg) {
+    if (statusMsg.length()) statusMsg += "<br />";
+    statusMsg += msg;
+  };
   // set-time: 2024-01-01T00:00
   if (webserver.hasArg("set-time")) {
     const String dateTimeStr = webserver.arg("set-time");
@@ -130,10 +295,55 @@ void http_configPageSave()
 
     if (sscanf(dateTimeStr.c_str(), "%d-%d-%dT%d:%d:%d", &year, &month, &day,
                &hour, &minute, &second) == 6) {
-      setTime(hour, minute, second, day, month, year);
-      statusMsg += "Time set!";
+      timekeeping::setLocal(year, month, day, hour, minute, second);
+      status("Time set!");
     } else {
-      statusMsg += "Error setting time!";
+      status("Error setting time!");
+    }
+  }
+  if (webserver.hasArg("timezone")) {
+    const String tz = webserver.arg("timezone");
+    // the form always sends the zone; only a new one resets zone state
+    if (tz != settings::current.timezone) {
+      if (tz.length() >= sizeof(settings::current.timezone) ||
+          !timekeeping::setZone(tz.c_str())) {
+        status("Invalid time zone!");
+      } else {
+        strlcpy(settings::current.timezone, tz.c_str(),
+                sizeof(settings::current.timezone));
+        settings::save();
+        status("Time zone set!");
+      }
+    }
+  }
+  if (webserver.hasArg("power-mode")) {
+    uint8_t mode = webserver.arg("power-mode").toInt();
+    if (mode != settings::current.powerMode) {
+      sleep::setPowerMode(mode);
+      settings::current.powerMode = sleep::powerMode;
+      settings::save();
+      status("Power mode set!");
+    }
+  }
+  if (webserver.hasArg("beacon")) {
+    bool enable = webserver.arg("beacon").toInt() != 0;
+    if (enable != settings::current.beacon) {
+      beacon::setEnabled(enable);
+      settings::current.beacon = enable;
+      settings::save();
+      status(enable ? "Beacon on!" : "Beacon off!");
+    }
+  }
+  if (webserver.hasArg("r0-action")) {
+    settings::ScheduleRule rules[settings::scheduleSize];
+    for (uint8_t i = 0; i < settings::scheduleSize; i++) {
+      rules[i] = parseScheduleRow(i);
+    }
+    if (memcmp(rules, settings::current.schedule, sizeof(rules)) != 0) {
+      memcpy(settings::current.schedule, rules, sizeof(rules));
+      settings::save();
+      schedule::rebuild();
+      status("Schedule saved!");
     }
   }
   String html = FPSTR(htmlHead);
@@ -148,6 +358,7 @@ void http_configPageSave()
   html.replace("%DEVICE_NAME%", DEVICE_NAME);
   html.replace("%REFRESH_CONTENT%", "3;/");
 
+  sampleHeap();
   webserver.send(200, "text/html", html);
 }
 
@@ -178,12 +389,221 @@ void http_sync()
 
 void http_getTimedate()
 {
+  const timekeeping::DateTime &t = timekeeping::local;
+
   webserver.send(
       200, "application/json",
-      "{\"hour\":" + String(hour()) + ", \"minute\":" + String(minute()) +
-          ", \"second\":" + String(second()) + ", \"isAM\":" + String(isAM()) +
-          ", \"day\":" + String(day()) + ", \"month\":" + String(month()) +
-          ", \"year\":" + String(year()) + "}");
+      "{\"hour\":" + String(t.hour) + ", \"minute\":" + String(t.minute) +
+          ", \"second\":" + String(t.second) + ", \"isAM\":" + String(t.isAM) +
+          ", \"day\":" + String(t.day) + ", \"month\":" + String(t.month) +
+          ", \"year\":" + String(t.year) + "}");
+}
+
+/**
+ * @brief Handle "/firmware" URL request: identify the running firmware so
+ * the build script can decide whether a delta patch applies
+ */
+void http_firmware()
+{
+  webserver.send(200, "application/json",
+                 "{\"version\":\"" VERSION "\", \"md5\":\"" +
+                     ESP.getSketchMD5() +
+                     "\", \"size\":" + String(ESP.getSketchSize()) + "}");
+}
+
+/**
+ * @brief Handle "/delta" upload: stream a delta patch into the OTA partition
+ */
+void http_deltaUpload()
+{
+  HTTPUpload &upload = webserver.upload();
+
+  if (upload.status == UPLOAD_FILE_START) {
+    wifi::otaBegin("DELTA", journal::OTA_DELTA);
+    delta::begin();
+  } else if (upload.status == UPLOAD_FILE_WRITE) {
+    delta::write(upload.buf, upload.currentSize);
+    wifi::otaProgress(delta::written, delta::targetSize);
+  } else if (upload.status == UPLOAD_FILE_END) {
+    delta::end();
+  } else if (upload.status == UPLOAD_FILE_ABORTED) {
+    delta::abort();
+    wifi::otaEnd(false);
+  }
+}
+
+void http_deltaDone()
+{
+  // the patch is applied as it arrives, so rate is for the image written
+  bool success = delta::applied;
+  delta::applied = false;
+  uint32_t rate = wifi::otaActive ? wifi::otaEnd(success) : 0;
+
+  if (!success) {
+    // no file part at all means the upload callback never ran
+    if (delta::error.length() == 0) {
+      webserver.send(400, "text/plain", "no patch uploaded");
+    } else {
+      webserver.send(delta::baseMismatch ? 409 : 500, "text/plain",
+                     delta::error);
+    }
+    return;
+  }
+
+  webserver.send(200, "text/plain",
+                 "Delta applied at " + String(rate) + " KB/s, restarting");
+  restartDevice = true;
+}
+
+/**
+ * @brief Handle "/ntp" URL request: sync quality summary, with the history
+ * charted client side from /ntp.csv
+ */
+void http_ntpPage()
+{
+  const wifi::NtpSummary &s = wifi::ntpSummary;
+
+  String html = FPSTR(htmlHead);
+  html += FPSTR(htmlStyle);
+  html += FPSTR(htmlHeadEnd);
+  html += FPSTR(htmlHeading);
+  html += FPSTR(htmlNtp);
+
+  html.replace("%DEVICE_NAME%", DEVICE_NAME);
+  html.replace("%ntpAttempts%", String(s.attempts));
+  html.replace("%ntpFailures%", String(s.failures));
+  html.replace("%ntpLastOffset%", String(s.lastOffset));
+  html.replace("%ntpMaxOffset%", String(s.maxOffset));
+  html.replace("%ntpJitter%", String(s.jitter));
+  html.replace("%ntpDelayAvg%", String(s.good ? s.delaySum / s.good : 0));
+  html.replace("%ntpDelayMin%", String(s.good ? s.minDelay : 0));
+  html.replace("%ntpDelayMax%", String(s.maxDelay));
+  html.replace("%ntpDrift%", String(s.driftPpm));
+  html.replace("%ntpHeld%", String(wifi::ntpHistoryLength()));
+  html += FPSTR(htmlFooter);
+
+  sampleHeap();
+  webserver.send(200, "text/html", html);
+}
+
+/**
+ * @brief Handle "/ntp.csv" URL request: the NTP sample history, oldest
+ * first, streamed in small chunks rather than built up in one String. Times
+ * are reconstructed from uptime against the current clock, so are blank
+ * until it has been set.
+ */
+void http_ntpHistory()
+{
+  constexpr size_t chunkSize = 512;
+  bool timeSet = timekeeping::isSet();
+  time_t now = timeSet ? timekeeping::utcNow() : 0;
+
+  webserver.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  webserver.send(200, "text/csv", "");
+
+  String chunk;
+  chunk.reserve(chunkSize + 64);
+  chunk = F("time,uptime,server,offset_ms,delay_ms,stratum,result\n");
+  for (uint8_t i = 0; i < wifi::ntpHistoryLength(); i++) {
+    const wifi::NtpSample &sample = wifi::ntpSample(i);
+    if (timeSet) chunk += String((uint32_t)(now - (uptime - sample.uptime)));
+    chunk += ',';
+    chunk += String(sample.uptime);
+    chunk += ',';
+    chunk += IPAddress(sample.server).toString();
+    chunk += ',';
+    chunk += String(sample.offset);
+    chunk += ',';
+    chunk += String(sample.delay);
+    chunk += ',';
+    chunk += String(sample.stratum);
+    chunk += ',';
+    chunk += wifi::ntpResultName(sample.result);
+    chunk += '\n';
+    if (chunk.length() >= chunkSize) {
+      webserver.sendContent(chunk);
+      chunk = "";
+    }
+  }
+  if (chunk.length()) webserver.sendContent(chunk);
+  webserver.sendContent("");  // ends the chunked response
+}
+
+/**
+ * @brief Readable form of a journal record's value, where it has one
+ */
+String journalDetail(const journal::Record &r)
+{
+  switch (r.type) {
+    case journal::EVENT_BOOT: return journal::resetReasonName(r.value);
+    case journal::EVENT_CRASH: return "0x" + String(r.value, HEX);
+    case journal::EVENT_RESTART: return journal::restartCauseName(r.value);
+    case journal::EVENT_NTP_FAIL: return wifi::ntpResultName(r.value);
+    case journal::EVENT_NTP_OK: return String(r.value) + " failed attempts";
+    case journal::EVENT_OTA_START:
+      return r.value == journal::OTA_DELTA ? "delta" : "arduino";
+    default: return "";
+  }
+}
+
+/**
+ * @brief Handle "/journal.csv" URL request: the persistent event journal,
+ * oldest first, streamed in small chunks. Time is blank for records made
+ * before the clock was set.
+ */
+void http_journal()
+{
+  constexpr size_t chunkSize = 512;
+
+  webserver.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  webserver.send(200, "text/csv", "");
+
+  String chunk;
+  chunk.reserve(chunkSize + 64);
+  chunk = F("boot,uptime,time,event,value,detail\n");
+  journal::forEach([&chunk](const journal::Record &r) {
+    chunk += String(r.boot);
+    chunk += ',';
+    chunk += String(r.uptime);
+    chunk += ',';
+    if (r.utc) chunk += String(r.utc);
+    chunk += ',';
+    chunk += journal::eventName(r.type);
+    chunk += ',';
+    chunk += String(r.value);
+    chunk += ',';
+    chunk += journalDetail(r);
+    chunk += '\n';
+    if (chunk.length() >= chunkSize) {
+      webserver.sendContent(chunk);
+      chunk = "";
+    }
+  });
+  if (chunk.length()) webserver.sendContent(chunk);
+  webserver.sendContent("");  // ends the chunked response
+}
+
+/**
+ * @brief Handle "/stats" URL request: heap and timing figures for load
+ * testing (see scripts/loadtest.py). Low water / worst case values cover
+ * the time since the previous request and are reset by it.
+ */
+void http_stats()
+{
+  sampleHeap();
+  webserver.send(
+      200, "application/json",
+      "{\"uptime\":" + String(uptime) +
+          ", \"freeHeap\":" + String(ESP.getFreeHeap()) +
+          ", \"heapLowWater\":" + String(heapLowWater) +
+          ", \"maxFreeBlock\":" + String(ESP.getMaxFreeBlockSize()) +
+          ", \"heapFragmentation\":" + String(ESP.getHeapFragmentation()) +
+          ", \"loopLoadAvg\":" + String(loop_load_avg) +
+          ", \"tickErrorMax\":" + String(tickErrorMax) +
+          ", \"loopGapMax\":" + String(loopGapMax) + "}");
+  heapLowWater = UINT32_MAX;
+  tickErrorMax = 0;
+  loopGapMax = 0;
 }
 
 void setupHTTP()
@@ -196,9 +616,32 @@ void setupHTTP()
   webserver.on("/configSave", http_configPageSave);
   webserver.on("/sync", http_sync);
   webserver.on("/resetWifi", http_resetWifi);
+  webserver.on("/firmware", http_firmware);
+  webserver.on("/stats", http_stats);
+  webserver.on("/ntp", http_ntpPage);
+  webserver.on("/ntp.csv", http_ntpHistory);
+  webserver.on("/journal.csv", http_journal);
+  webserver.on("/delta", HTTP_POST, http_deltaDone, http_deltaUpload);
   webserver.onNotFound(notFound);
   webserver.begin();
+
+  wifi::pauseWebserver = [](bool paused) {
+    if (paused) {
+      webserver.stop();
+    } else {
+      webserver.begin();
+    }
+  };
 }
 
-void loopTask() { webserver.handleClient(); }
+void loopTask()
+{
+  uint32_t now = millis();
+  if (lastLoop) loopGapMax = max(loopGapMax, now - lastLoop);
+  lastLoop = now;
+
+  webserver.handleClient();
+  sampleHeap();
+  tickErrorMax = max(tickErrorMax, sleep::powerStats.tickErrorMs);
+}
 }  // namespace webserver
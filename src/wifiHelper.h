@@ -6,8 +6,12 @@
 #include <ESP8266mDNS.h>    // Multicast DNS (for OTA)
 #include <WiFiManager.h>    // WiFi Configuration Portal
 #include <WiFiUdp.h>        // UDP support (for NTP)
+#include <beaconHelper.h>   // LAN time beacon
 #include <displayHelper.h>  // Display helper functions
 #include <globals.h>        // Global libraries and variables
+#include <journalHelper.h>  // Persistent event journal
+#include <sensorHelper.h>   // Sensor helper functions
+#include <timeHelper.h>     // Time keeping
 
 namespace wifi
 {
@@ -22,12 +26,29 @@ constexpr uint8_t NTP_PACKET_SIZE =
 byte packetBuffer[NTP_PACKET_SIZE];  // buffer to hold incoming & outgoing
                                      // packets
 
-uint32_t last_event = 0;    // Last wiFi connection event
-uint32_t downtime = 0;      // WiFi down duration
+constexpr uint32_t NTP_UNIX_OFFSET = 2208988800UL;  // 1900 to 1970 seconds
+constexpr uint32_t ntpRetryInterval = 60;  // seconds after a first failure
+uint32_t ntpSyncInterval = ntpUpdateInterval;  // seconds between syncs
+uint32_t ntpRetryDelay = ntpRetryInterval;     // doubles per failure, seconds
+uint64_t nextNtpSync = 0;                      // monotonic ms of next sync
+
+uint32_t last_event = 0;    // Uptime WiFi was last seen connected
+uint32_t downtime = 0;      // Length of the current WiFi outage, seconds
 const int haltDelay = 200;  // delay in ms before webserver/wifi halted
 
 WiFiManager wifiManager;
 
+// OTA mode. Both kinds of update run to completion inside a single call from
+// loop() (ArduinoOTA.handle() or handleClient()), so loop() itself never
+// sees it; what it does is pause the motion interrupt and throttle redraws
+constexpr uint16_t otaFrameInterval = 100;  // ms between progress redraws
+bool otaActive = false;
+std::function<void(bool)> pauseWebserver;  // Set by webserver::setupHTTP()
+uint32_t otaStarted = 0;   // millis() when the update began
+uint32_t otaLastDraw = 0;  // millis() of the last progress redraw
+uint8_t otaLastPercent = 0;
+uint32_t otaBytes = 0;  // Bytes received so far
+
 // send an NTP request to the time server at the given address
 void sendNTPpacket(IPAddress &address)
 {
@@ -51,36 +72,244 @@ void sendNTPpacket(IPAddress &address)
   udp.endPacket();
 }
 
-time_t getNtpTime()
+// convert a 64 bit NTP timestamp (seconds + 32 bit fraction) to Unix ms
+uint64_t parseNtpTimestamp(const byte *ts)
+{
+  uint32_t seconds = (uint32_t)ts[0] << 24 | (uint32_t)ts[1] << 16 |
+                     (uint32_t)ts[2] << 8 | ts[3];
+  uint32_t fraction = (uint32_t)ts[4] << 24 | (uint32_t)ts[5] << 16 |
+                      (uint32_t)ts[6] << 8 | ts[7];
+  return (uint64_t)(seconds - NTP_UNIX_OFFSET) * 1000 +
+         (((uint64_t)fraction * 1000) >> 32);
+}
+
+/*********************************************************************************************\
+ * NTP sample history
+ *
+ * Every sync attempt is kept in a ring of 16 byte records, oldest overwritten
+ * first. Summary figures are updated as each sample goes in, so reporting
+ * them never walks the ring.
+\*********************************************************************************************/
+
+enum NtpResult : uint8_t { NTP_OK, NTP_NO_DNS, NTP_TIMEOUT, NTP_BAD_REPLY };
+
+struct NtpSample {
+  uint32_t uptime;  // Seconds since boot when the sync ran
+  uint32_t server;  // IPv4 address that answered (or was asked)
+  int32_t offset;   // ms, server minus local clock; 0 for the first set
+  uint16_t delay;   // Round trip, ms
+  uint8_t stratum;
+  uint8_t result;  // NtpResult
+};
+static_assert(sizeof(NtpSample) == 16, "NtpSample should pack to 16 bytes");
+
+struct NtpSummary {
+  uint32_t attempts;
+  uint32_t failures;
+  int32_t lastOffset;     // ms
+  uint32_t maxOffset;     // ms, largest correction seen
+  uint32_t jitter;        // ms, smoothed change in offset between syncs
+  int32_t driftPpm;       // Rate error between the last two, negative if fast
+  uint16_t minDelay;      // ms
+  uint16_t maxDelay;      // ms
+  uint32_t delaySum;      // ms, over good samples, for the average
+  uint32_t good;          // Samples with result NTP_OK
+  uint32_t lastGoodUptime;
+};
+
+constexpr uint8_t ntpHistorySize = 32;  // Power of two, ~10 days at 8 hourly
+NtpSample ntpHistory[ntpHistorySize];
+uint32_t ntpHistoryCount = 0;  // Samples ever recorded
+NtpSummary ntpSummary = {0, 0, 0, 0, 0, 0, UINT16_MAX, 0, 0, 0, 0};
+uint32_t ntpFailStreak = 0;  // Failed attempts since the last good one
+
+const char *ntpResultName(uint8_t result)
+{
+  switch (result) {
+    case NTP_OK: return "ok";
+    case NTP_NO_DNS: return "no-dns";
+    case NTP_TIMEOUT: return "timeout";
+    default: return "bad-reply";
+  }
+}
+
+/**
+ * @brief i-th oldest sample still held, for i < ntpHistoryLength()
+ */
+const NtpSample &ntpSample(uint8_t i)
+{
+  uint32_t first = ntpHistoryCount > ntpHistorySize
+                       ? ntpHistoryCount - ntpHistorySize
+                       : 0;
+  return ntpHistory[(first + i) & (ntpHistorySize - 1)];
+}
+
+uint8_t ntpHistoryLength() { return min<uint32_t>(ntpHistoryCount, ntpHistorySize); }
+
+void recordNtpSample(const NtpSample &sample)
+{
+  ntpHistory[ntpHistoryCount++ & (ntpHistorySize - 1)] = sample;
+
+  NtpSummary &s = ntpSummary;
+  s.attempts++;
+  if (sample.result != NTP_OK) {
+    s.failures++;
+    // an outage is journalled as its first failure and the count on recovery
+    if (!ntpFailStreak++) {
+      journal::append(journal::EVENT_NTP_FAIL, sample.result);
+    }
+    return;
+  }
+  if (ntpFailStreak) {
+    journal::append(journal::EVENT_NTP_OK, ntpFailStreak);
+    ntpFailStreak = 0;
+  }
+
+  // the first good sample sets the clock, so has no offset to speak of
+  uint32_t magnitude = abs(sample.offset);
+  if (s.good) {
+    uint32_t interval = sample.uptime - s.lastGoodUptime;
+    if (interval) s.driftPpm = (int64_t)sample.offset * 1000 / interval;
+  }
+  if (s.good > 1) {
+    // RFC 5905 style: exponential average (1/4) of the change in offset
+    uint32_t change = abs(sample.offset - s.lastOffset);
+    s.jitter = (s.jitter * 3 + change) / 4;
+  }
+  s.lastOffset = sample.offset;
+  s.maxOffset = max(s.maxOffset, magnitude);
+  s.minDelay = min(s.minDelay, sample.delay);
+  s.maxDelay = max(s.maxDelay, sample.delay);
+  s.delaySum += sample.delay;
+  s.good++;
+  s.lastGoodUptime = sample.uptime;
+}
+
+/**
+ * @brief Query the NTP pool and discipline the time core, allowing for half
+ * the round trip delay. Every attempt is recorded in ntpHistory.
+ *
+ * @return true if the clock was set
+ */
+bool syncNtpTime()
 {
   IPAddress ntpServerIP;  // NTP server's ip address
+  NtpSample sample = {uptime, 0, 0, 0, 0, NTP_TIMEOUT};
 
   while (udp.parsePacket() > 0)
     ;  // discard any previously received packets
   DebugPrintln("Transmit NTP Request");
   // get a random server from the pool
-  WiFi.hostByName(ntpServerName, ntpServerIP);
+  if (!WiFi.hostByName(ntpServerName, ntpServerIP)) {
+    DebugPrintln("NTP server lookup failed");
+    sample.result = NTP_NO_DNS;
+    recordNtpSample(sample);
+    return false;
+  }
   DebugPrint(ntpServerName);
   DebugPrint(": ");
   DebugPrintln(ntpServerIP);
+  sample.server = ntpServerIP;
   sendNTPpacket(ntpServerIP);
+  uint64_t sent = timekeeping::monotonicMillis();
   uint32_t beginWait = millis();
   while (millis() - beginWait < 1500) {
     int size = udp.parsePacket();
     if (size >= NTP_PACKET_SIZE) {
+      uint64_t received = timekeeping::monotonicMillis();
       DebugPrintln("Receive NTP Response");
       udp.read(packetBuffer, NTP_PACKET_SIZE);  // read packet into the buffer
-      unsigned long secsSince1900;
-      // convert four bytes starting at location 40 to a long integer
-      secsSince1900 = (unsigned long)packetBuffer[40] << 24;
-      secsSince1900 |= (unsigned long)packetBuffer[41] << 16;
-      secsSince1900 |= (unsigned long)packetBuffer[42] << 8;
-      secsSince1900 |= (unsigned long)packetBuffer[43];
-      return secsSince1900 - 2208988800UL + timeZone * SECS_PER_HOUR;
+      sample.server = udp.remoteIP();
+      sample.delay = min<uint64_t>(received - sent, UINT16_MAX);
+      sample.stratum = packetBuffer[1];
+
+      // unsynchronised server (leap indicator 3) or kiss-o'-death (stratum 0)
+      if ((packetBuffer[0] >> 6) == 3 || sample.stratum == 0 ||
+          sample.stratum > 15) {
+        DebugPrintln("NTP server not synchronised");
+        sample.result = NTP_BAD_REPLY;
+        recordNtpSample(sample);
+        return false;
+      }
+
+      // transmit timestamp starts at byte 40
+      uint64_t serverMs = parseNtpTimestamp(packetBuffer + 40);
+      timekeeping::setUtcMillis(serverMs + (received - sent) / 2, received);
+      DebugPrintf("NTP step %d ms\n", timekeeping::lastStepMs);
+      sample.offset = timekeeping::lastStepMs;
+      sample.result = NTP_OK;
+      beacon::hasNtpTime = true;
+      recordNtpSample(sample);
+      return true;
     }
+    yield();
   }
   DebugPrintln("No NTP Response :-(");
-  return 0;  // return 0 if unable to get the time
+  recordNtpSample(sample);
+  return false;
+}
+
+/**
+ * @brief Enter OTA mode: disarm the motion interrupt and FIFO tracking so
+ * flash writes and TCP ACKs get the CPU
+ */
+void otaBegin(const char *msg, journal::OtaKind kind)
+{
+  journal::append(journal::EVENT_OTA_START, kind);
+  otaActive = true;
+  otaStarted = millis();
+  otaLastDraw = otaStarted;
+  otaLastPercent = 0;
+  otaBytes = 0;
+  sensor::pause(true);
+  DebugPrintln(msg);
+  display::printMsg(msg);
+}
+
+/**
+ * @brief Record progress, redrawing only on whole percent changes and at
+ * most once per otaFrameInterval
+ */
+void otaProgress(uint32_t progress, uint32_t total)
+{
+  otaBytes = progress;
+  if (!total) return;
+
+  uint8_t percent = (uint64_t)progress * 100 / total;
+  if (percent == otaLastPercent) return;
+  if (percent < 100 && (millis() - otaLastDraw) < otaFrameInterval) return;
+
+  otaLastPercent = percent;
+  otaLastDraw = millis();
+  display::printProgress(percent);
+}
+
+/**
+ * @brief Leave OTA mode, reporting the effective transfer rate
+ *
+ * @return rate in KB/s
+ */
+uint32_t otaEnd(bool success)
+{
+  uint32_t elapsed = max<uint32_t>(millis() - otaStarted, 1);
+  uint32_t rate = (uint64_t)otaBytes * 1000 / 1024 / elapsed;
+
+  DebugPrintf("*OTA: %s, %u bytes in %u ms, %u KB/s\n",
+              success ? "done" : "failed", otaBytes, elapsed, rate);
+  if (success) {
+    display::printMsg(String(rate) + "K/s");
+  } else {
+    display::printMsg("OTA ER");
+  }
+
+  // the device restarts straight after a successful update
+  journal::append(success ? journal::EVENT_OTA_DONE : journal::EVENT_OTA_FAILED,
+                  rate);
+  journal::flush();
+
+  otaActive = false;
+  sensor::pause(false);
+  return rate;
 }
 
 void setupOTA()
@@ -88,19 +317,15 @@ void setupOTA()
   ArduinoOTA.setHostname(OTA_HOSTNAME);
 
   ArduinoOTA.onStart([]() {
-    DebugPrintln("OTA Programming Start");
-    display::printMsg("OTA");
+    // nothing else is serviced while ArduinoOTA streams the image, so close
+    // the web server rather than leave clients queueing in lwIP
+    if (pauseWebserver) pauseWebserver(true);
+    otaBegin("OTA", journal::OTA_ARDUINO);
   });
 
-  ArduinoOTA.onEnd([]() {
-    DebugPrintln("\nOTA Programming End");
-    display::printMsg("DONE!");
-  });
+  ArduinoOTA.onEnd([]() { otaEnd(true); });
 
-  ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
-    DebugPrintf("Progress: %u%%\r", (progress / (total / 100)));
-    display::printProgress(progress, total);
-  });
+  ArduinoOTA.onProgress(otaProgress);
 
   ArduinoOTA.onError([](ota_error_t error) {
     DebugPrintf("Error[%u]: ", error);
@@ -116,7 +341,13 @@ void setupOTA()
     else if (error == OTA_END_ERROR)
       DebugPrintln("End Failed");
 
-    display::printMsg("OTA ER");
+    // errors before onStart (e.g. auth) never entered OTA mode
+    if (otaActive) {
+      otaEnd(false);
+      if (pauseWebserver) pauseWebserver(false);
+    } else {
+      display::printMsg("OTA ER");
+    }
   });
 
   ArduinoOTA.setHostname(HOSTNAME);
@@ -127,9 +358,11 @@ void setupOTA()
 void WifiSetState(uint8_t state)
 {
   if (state) {
-    downtime += uptime - last_event;
-  } else {
+    if (downtime) journal::append(journal::EVENT_WIFI_DOWN, downtime);
     last_event = uptime;
+    downtime = 0;
+  } else {
+    downtime = uptime - last_event;
   }
 }
 
@@ -160,10 +393,39 @@ void configModeCallback(WiFiManager *myWiFiManager)
   DebugPrintln(myWiFiManager->getConfigPortalSSID());
 }
 
+/**
+ * @brief Set the sync interval and sync as soon as possible
+ */
 void setupNTP(unsigned int syncInterval)
 {
-  setSyncProvider(getNtpTime);
-  setSyncInterval(syncInterval);
+  ntpSyncInterval = syncInterval;
+  ntpRetryDelay = ntpRetryInterval;
+  nextNtpSync = 0;
+}
+
+void ntpLoopTask()
+{
+  uint64_t now = timekeeping::monotonicMillis();
+  if (now < nextNtpSync) return;
+
+  // clocks following a LAN beacon take their time from it; forced syncs
+  // (setupNTP()) still go ahead
+  if (nextNtpSync && beacon::following()) {
+    nextNtpSync = now + ntpRetryInterval * 1000ULL;
+    return;
+  }
+
+  // each failed attempt blocks the loop while it waits for a reply, so back
+  // off exponentially while the server stays unreachable
+  uint32_t interval;
+  if (syncNtpTime()) {
+    interval = ntpSyncInterval;
+    ntpRetryDelay = ntpRetryInterval;
+  } else {
+    interval = min(ntpRetryDelay, ntpSyncInterval);
+    ntpRetryDelay = min(ntpRetryDelay * 2, ntpSyncInterval);
+  }
+  nextNtpSync = timekeeping::monotonicMillis() + interval * 1000ULL;
 }
 
 void setupUDP()
@@ -202,6 +464,7 @@ void eraseWifi()
   ESP.eraseConfig();
   WiFi.disconnect();
   delay(haltDelay);
+  journal::logRestart(journal::RESTART_WIFI_ERASED);
   ESP.restart();
   delay(haltDelay);
 }
@@ -0,0 +1,156 @@
+/**
+ * Host microbenchmarks for the firmware hot paths (pio run -e native-bench)
+ *
+ * Each benchmark is batched until a batch takes at least minRunTime of wall
+ * clock time, and the fastest of `repeats` batches is reported as
+ * nanoseconds per operation. Redirect the output to a file to keep a
+ * baseline, and pass that file on a later run to fail on any benchmark that
+ * got more than `tolerance` (default 1.25x) slower:
+ *
+ *   .pio/build/native-bench/program > baseline.txt
+ *   .pio/build/native-bench/program baseline.txt [tolerance]
+ */
+
+#include <globals.h>          // Global libraries and variables
+#include <webserverHelper.h>  // Web server helper functions
+#include <wifiHelper.h>       // WiFi helper functions
+
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+constexpr auto minRunTime = std::chrono::milliseconds(100);
+constexpr int repeats = 5;
+double tolerance = 1.25;
+
+struct Result {
+  const char *name;
+  uint64_t iterations;
+  double nsPerOp;
+};
+
+std::vector<Result> results;
+volatile uint64_t sink;  // Keeps results alive past the optimiser
+
+template <typename Fn>
+double timeBatch(Fn &fn, uint64_t iterations)
+{
+  using clock = std::chrono::steady_clock;
+  auto start = clock::now();
+  for (uint64_t i = 0; i < iterations; i++) fn();
+  return std::chrono::duration<double, std::nano>(clock::now() - start)
+      .count();
+}
+
+template <typename Fn>
+void measure(const char *name, Fn fn)
+{
+  constexpr double minNs =
+      std::chrono::duration<double, std::nano>(minRunTime).count();
+
+  // size the batch, then keep the fastest of a few to shed scheduler noise
+  uint64_t iterations = 1;
+  while (timeBatch(fn, iterations) < minNs) iterations *= 2;
+  double best = timeBatch(fn, iterations);
+  for (int i = 1; i < repeats; i++) {
+    best = std::min(best, timeBatch(fn, iterations));
+  }
+
+  results.push_back({name, iterations, best / iterations});
+  printf("%-24s %12.1f ns/op %10llu iterations\n", name, best / iterations,
+         (unsigned long long)iterations);
+}
+
+String get(const char *uri)
+{
+  fake::HttpRequest req;
+  req.uri = uri;
+  return webserver::webserver.request(req).content;
+}
+
+int compare(const char *path)
+{
+  std::ifstream file(path);
+  if (!file) {
+    fprintf(stderr, "can't read baseline %s\n", path);
+    return 2;
+  }
+
+  std::map<std::string, double> baseline;
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    std::string name;
+    double ns;
+    if (fields >> name >> ns) baseline[name] = ns;
+  }
+
+  int regressions = 0;
+  for (const Result &r : results) {
+    auto it = baseline.find(r.name);
+    if (it == baseline.end()) continue;
+    double ratio = r.nsPerOp / it->second;
+    if (ratio > tolerance) {
+      printf("# REGRESSION %s: %.1f -> %.1f ns/op (x%.2f)\n", r.name,
+             it->second, r.nsPerOp, ratio);
+      regressions++;
+    }
+  }
+  printf("# %d regression(s) against %s\n", regressions, path);
+  return regressions ? 1 : 0;
+}
+}  // namespace
+
+int main(int argc, char **argv)
+{
+  constexpr uint64_t now = 1718000000123ULL;  // 2024-06-10, mid winter AEST
+
+  settings::load();
+  timekeeping::setZone(defaultTimezone);
+  timekeeping::setUtcMillis(now, timekeeping::monotonicMillis());
+  timekeeping::tick();
+  webserver::setupHTTP();
+
+  // NTP: timestamp decode alone, and a whole request/response exchange
+  std::vector<uint8_t> reply = fake::ntpReply(fake::Datagram(), now).data;
+  measure("ntp/parse-timestamp", [&] {
+    reply[47]++;  // vary the fraction so the decode can't be hoisted
+    sink = wifi::parseNtpTimestamp(reply.data() + 40);
+  });
+
+  wifi::setupUDP();
+  fake::onUdpSend = [&](const fake::Datagram &request) {
+    fake::udpInbox.push_back(fake::ntpReply(request, now));
+  };
+  measure("ntp/sync-exchange", [] { sink = wifi::syncNtpTime(); });
+  fake::onUdpSend = nullptr;
+
+  // pages
+  measure("page/index", [] { sink = get("/").length(); });
+  measure("page/info", [] { sink = get("/info").length(); });
+  measure("page/config", [] { sink = get("/config").length(); });
+  measure("page/ntp", [] { sink = get("/ntp").length(); });
+  measure("page/ntp-csv", [] { sink = get("/ntp.csv").length(); });
+
+  // clock face: local time breakdown and composing the frame
+  measure("clock/break-local-time", [] {
+    timekeeping::DateTime dt;
+    timekeeping::breakTime(timekeeping::toLocal(timekeeping::utcNow()), dt);
+    sink = dt.second;
+  });
+  measure("clock/compose-frame", [] {
+    display::digitalClockDisplay();
+    sink = display::matrix.bitmap[0];
+  });
+
+  // JSON
+  measure("json/getTimedate", [] { sink = get("/getTimedate").length(); });
+  measure("json/firmware", [] { sink = get("/firmware").length(); });
+
+  if (argc > 2) tolerance = atof(argv[2]);
+  return argc > 1 ? compare(argv[1]) : 0;
+}
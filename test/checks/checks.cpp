@@ -0,0 +1,183 @@
+/**
+ * Host checks of firmware behaviour with one right answer, run against the
+ * fakes (pio run -e native-checks -t exec). Each failed check is printed;
+ * the program exits non-zero if there were any.
+ */
+
+#include <globals.h>         // Global libraries and variables
+#include <scheduleHelper.h>  // Scheduled actions
+#include <timeHelper.h>      // Time keeping
+
+#include <string>
+
+namespace
+{
+int checks = 0;
+int failures = 0;
+
+void expect(const char *what, int64_t got, int64_t want)
+{
+  checks++;
+  if (got == want) return;
+  failures++;
+  printf("FAIL %s: got %lld, want %lld\n", what, (long long)got,
+         (long long)want);
+}
+
+void expect(const char *what, const std::string &got, const std::string &want)
+{
+  checks++;
+  if (got == want) return;
+  failures++;
+  printf("FAIL %s:\n  got  %s\n  want %s\n", what, got.c_str(), want.c_str());
+}
+
+time_t utc(int year, int month, int day, int hour, int minute)
+{
+  return timekeeping::makeTime(year, month, day, hour, minute, 0);
+}
+
+/*********************************************************************************************\
+ * Time zones
+\*********************************************************************************************/
+
+void checkToUtc()
+{
+  using timekeeping::toUtc;
+
+  timekeeping::setZone("EST5EDT,M3.2.0,M11.1.0");
+  expect("EST before gap", toUtc(utc(2026, 3, 8, 1, 30)),
+         utc(2026, 3, 8, 6, 30));
+  expect("EST gap", toUtc(utc(2026, 3, 8, 2, 30)), utc(2026, 3, 8, 7, 30));
+  expect("EST after gap", toUtc(utc(2026, 3, 8, 3, 30)),
+         utc(2026, 3, 8, 7, 30));
+  expect("EDT summer", toUtc(utc(2026, 7, 1, 12, 0)), utc(2026, 7, 1, 16, 0));
+  expect("EDT before overlap", toUtc(utc(2026, 11, 1, 0, 30)),
+         utc(2026, 11, 1, 4, 30));
+  expect("EST overlap", toUtc(utc(2026, 11, 1, 1, 30)),
+         utc(2026, 11, 1, 6, 30));
+  expect("EST after overlap", toUtc(utc(2026, 11, 1, 2, 30)),
+         utc(2026, 11, 1, 7, 30));
+
+  // southern hemisphere: DST spans the new year
+  timekeeping::setZone("AEST-10AEDT,M10.1.0,M4.1.0/3");
+  expect("AEST gap", toUtc(utc(2026, 10, 4, 2, 30)), utc(2026, 10, 3, 16, 30));
+  expect("AEDT summer", toUtc(utc(2026, 1, 1, 12, 0)), utc(2026, 1, 1, 1, 0));
+  expect("AEST overlap", toUtc(utc(2026, 4, 5, 2, 30)),
+         utc(2026, 4, 4, 16, 30));
+
+  timekeeping::setZone("UTC0");
+  expect("no DST", toUtc(utc(2026, 3, 8, 2, 30)), utc(2026, 3, 8, 2, 30));
+
+  // setLocal() inside the gap
+  timekeeping::setZone("EST5EDT,M3.2.0,M11.1.0");
+  timekeeping::setLocal(2026, 3, 8, 2, 30, 0);
+  expect("setLocal gap", timekeeping::utcNow(), utc(2026, 3, 8, 7, 30));
+}
+
+/*********************************************************************************************\
+ * Schedule
+\*********************************************************************************************/
+
+void setRule(uint8_t i, uint8_t action, uint8_t hour, uint8_t minute,
+             uint8_t value = 0)
+{
+  settings::current.schedule[i] = {action, hour, minute, schedule::EVERY_DAY,
+                                   value, ""};
+}
+
+void setClock(time_t utc)
+{
+  timekeeping::setUtcMillis((uint64_t)utc * 1000,
+                            timekeeping::monotonicMillis());
+}
+
+// What the schedule has made of the display, e.g. "blank 5"
+std::string displayState()
+{
+  return std::string(display::blanked ? "blank " : "lit ") +
+         std::to_string(display::matrix.intensity);
+}
+
+// One loop pass's worth of the schedule, as loop() runs it
+void scheduleTick() { schedule::loopTask(timekeeping::tick()); }
+
+/**
+ * @brief Run the schedule a second at a time until UTC until, listing each
+ * change to the display as "dd hh:mm state" in UTC
+ */
+std::string runSchedule(time_t until)
+{
+  std::string changes;
+  std::string state = displayState();
+  while (timekeeping::utcNow() < until) {
+    fake::advance(1000000);
+    scheduleTick();
+    if (displayState() == state) continue;
+
+    state = displayState();
+    timekeeping::DateTime t;
+    timekeeping::breakTime(timekeeping::utcNow(), t);
+    char line[32];
+    snprintf(line, sizeof(line), "%s%02d %02d:%02d %s",
+             changes.empty() ? "" : ", ", t.day, t.hour, t.minute,
+             state.c_str());
+    changes += line;
+  }
+  return changes;
+}
+
+void checkSchedule()
+{
+  using namespace schedule;
+
+  // a dark, dim night: on DST change days 01:30 / 02:30 fall in the overlap
+  // / gap, which resolve to standard time
+  memset(settings::current.schedule, 0, sizeof(settings::current.schedule));
+  setRule(0, ACTION_BLANK, 2, 30);
+  setRule(1, ACTION_UNBLANK, 6, 0);
+  setRule(2, ACTION_INTENSITY, 1, 30, 5);
+  setRule(3, ACTION_INTENSITY, 8, 0, 1);
+  timekeeping::setZone("EST5EDT,M3.2.0,M11.1.0");
+
+  // spring forward on the 8th
+  setClock(utc(2026, 3, 7, 17, 0));  // 12:00 EST
+  scheduleTick();
+  expect("replay at noon", displayState(), "lit 1");
+  expect("spring forward", runSchedule(utc(2026, 3, 9, 16, 0)),
+         "08 06:30 lit 5, 08 07:30 blank 5, 08 10:00 lit 5, 08 12:00 lit 1, "
+         "09 05:30 lit 5, 09 06:30 blank 5, 09 10:00 lit 5, 09 12:00 lit 1");
+
+  // fall back on 1 November: 01:30 happens twice but fires once
+  setClock(utc(2026, 10, 31, 16, 0));  // 12:00 EDT
+  scheduleTick();
+  expect("fall back", runSchedule(utc(2026, 11, 1, 17, 0)),
+         "01 06:30 lit 5, 01 07:30 blank 5, 01 11:00 lit 5, 01 13:00 lit 1");
+
+  // steps into and out of the blanking window replay it, and re-key the heap
+  setClock(utc(2026, 7, 1, 8, 0));  // 04:00 EDT
+  scheduleTick();
+  expect("step into window", displayState(), "blank 5");
+  expect("unblank after step", runSchedule(utc(2026, 7, 1, 10, 30)),
+         "01 10:00 lit 5");
+  setClock(utc(2026, 7, 1, 7, 0));  // back to 03:00 EDT
+  scheduleTick();
+  expect("step back into window", displayState(), "blank 5");
+
+  // a zone change re-keys too: 07:00 UTC is past the window
+  timekeeping::setZone("UTC0");
+  scheduleTick();
+  expect("zone change", displayState(), "lit 5");
+  expect("after zone change", runSchedule(utc(2026, 7, 2, 7, 0)),
+         "01 08:00 lit 1, 02 01:30 lit 5, 02 02:30 blank 5, 02 06:00 lit 5");
+}
+}  // namespace
+
+int main()
+{
+  checkToUtc();
+  checkSchedule();
+
+  printf("%d checks, %d failed\n", checks, failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Just enough of Adafruit_GFX to drive text and pixel drawing through
+// drawPixel(); glyphs are a fixed 5x7 pattern derived from the character so
+// rendering cost scales like the real font renderer.
+class Adafruit_GFX : public Print
+{
+ public:
+  Adafruit_GFX(int16_t w, int16_t h) : width_(w), height_(h) {}
+
+  virtual void drawPixel(int16_t x, int16_t y, uint16_t color) = 0;
+  virtual void fillScreen(uint16_t color);
+
+  void drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color,
+                uint16_t bg, uint8_t size);
+  void setCursor(int16_t x, int16_t y)
+  {
+    cursorX_ = x;
+    cursorY_ = y;
+  }
+  void setTextSize(uint8_t s) { textSize_ = s; }
+  void setTextWrap(bool w) { wrap_ = w; }
+  void setTextColor(uint16_t c) { textColor_ = c; }
+  int16_t width() const { return width_; }
+  int16_t height() const { return height_; }
+
+  size_t write(uint8_t c) override;
+  using Print::write;
+
+ protected:
+  int16_t width_, height_;
+  int16_t cursorX_ = 0, cursorY_ = 0;
+  uint8_t textSize_ = 1;
+  uint16_t textColor_ = 1;
+  bool wrap_ = true;
+};
@@ -0,0 +1,254 @@
+#pragma once
+
+// Host-side stand-in for the Arduino / ESP8266 core. Only the API surface the
+// firmware actually touches is provided; time is virtual and driven by
+// fake::clock so benchmarks and simulations are deterministic.
+
+#include <cmath>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <string>
+
+#include "WString.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define PROGMEM
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+#define PSTR(s) (s)
+#define F(s) (s)
+#define FPSTR(p) (p)
+#define strlen_P strlen
+#define memcpy_P memcpy
+
+constexpr uint8_t LOW = 0;
+constexpr uint8_t HIGH = 1;
+constexpr uint8_t INPUT = 0;
+constexpr uint8_t OUTPUT = 1;
+constexpr uint8_t INPUT_PULLUP = 2;
+constexpr int RISING = 1;
+constexpr int FALLING = 2;
+constexpr int CHANGE = 3;
+constexpr int HEX = 16;
+constexpr int DEC = 10;
+constexpr double PI = 3.14159265358979323846;
+
+constexpr uint8_t D0 = 16, D1 = 5, D2 = 4, D3 = 0, D4 = 2, D5 = 14, D6 = 12,
+                  D7 = 13, D8 = 15;
+constexpr uint8_t P0 = 2, P5 = 4;
+
+namespace fake
+{
+// Virtual millisecond/microsecond clock shared by all fakes
+struct Clock {
+  uint64_t micros = 0;
+  // Called whenever firmware code blocks (delay/yield); lets a simulator
+  // deliver scheduled events while the device "sleeps".
+  std::function<void(uint64_t untilMicros)> onAdvance;
+  // Follow the host's clock instead: delay() really sleeps (for serving
+  // real sockets, see ESP8266WebServer.h)
+  bool realTime = false;
+};
+Clock &clock();
+void advance(uint64_t us);
+extern uint32_t yieldMicros;  // Virtual time consumed by each yield()
+
+// When set, ESP.getFreeHeap() reports this instead of EspClass::freeHeap
+extern uint32_t (*freeHeapModel)();
+
+// GPIO levels and interrupt handlers, indexed by pin number
+constexpr int numPins = 17;
+extern uint8_t pinLevel[numPins];
+void setPin(uint8_t pin, uint8_t level);
+}  // namespace fake
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+inline int digitalPinToInterrupt(uint8_t pin) { return pin; }
+void attachInterrupt(int pin, void (*isr)(), int mode);
+void detachInterrupt(int pin);
+
+inline uint32_t esp_get_cycle_count() { return micros() * 80; }
+
+class Print
+{
+ public:
+  virtual ~Print() = default;
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buf, size_t len)
+  {
+    for (size_t i = 0; i < len; i++) write(buf[i]);
+    return len;
+  }
+  size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+
+  size_t print(const String &s) { return write(s.c_str()); }
+  size_t print(const char *s) { return write(s); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int n, int base = DEC) { return print(String(n, (unsigned char)base)); }
+  size_t print(unsigned int n, int base = DEC) { return print(String(n, (unsigned char)base)); }
+  size_t print(long n, int base = DEC) { return print(String(n, (unsigned char)base)); }
+  size_t print(unsigned long n, int base = DEC) { return print(String(n, (unsigned char)base)); }
+  size_t print(double n, int digits = 2) { return print(String(n, (unsigned char)digits)); }
+  template <typename T>
+  auto print(const T &p) -> decltype(p.toString(), size_t())
+  {
+    return print(p.toString());
+  }
+  template <typename T>
+  size_t println(const T &v)
+  {
+    size_t n = print(v);
+    return n + println();
+  }
+  size_t println() { return write("\r\n"); }
+  size_t printf(const char *fmt, ...)
+  {
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    return write((const uint8_t *)buf, len < 0 ? 0 : strlen(buf));
+  }
+};
+
+class HardwareSerial : public Print
+{
+ public:
+  bool echo = false;  // Mirror output to stdout
+  void begin(unsigned long) {}
+  int available() { return 0; }
+  int read() { return -1; }
+  size_t write(uint8_t c) override
+  {
+    if (echo) putchar(c);
+    return 1;
+  }
+  using Print::write;
+};
+extern HardwareSerial Serial;
+
+enum rst_reason {
+  REASON_DEFAULT_RST,
+  REASON_WDT_RST,
+  REASON_EXCEPTION_RST,
+  REASON_SOFT_WDT_RST,
+  REASON_SOFT_RESTART,
+  REASON_DEEP_SLEEP_AWAKE,
+  REASON_EXT_SYS_RST
+};
+
+struct rst_info {
+  uint32_t reason;
+  uint32_t exccause;
+  uint32_t epc1;
+  uint32_t epc2;
+  uint32_t epc3;
+  uint32_t excvaddr;
+  uint32_t depc;
+};
+
+class EspClass
+{
+ public:
+  uint32_t freeHeap = 40000;
+  uint8_t heapFragmentation = 5;
+  uint32_t maxFreeBlock = 30000;
+  uint32_t restarts = 0;
+  uint32_t sketchSize = 400000;
+  String sketchMD5 = "00000000000000000000000000000000";
+
+  void restart() { restarts++; }
+  void reset() { restarts++; }
+  bool eraseConfig() { return true; }
+  uint32_t getFreeHeap()
+  {
+    return fake::freeHeapModel ? fake::freeHeapModel() : freeHeap;
+  }
+  uint8_t getHeapFragmentation() { return heapFragmentation; }
+  uint32_t getMaxFreeBlockSize() { return maxFreeBlock; }
+  String getCoreVersion() { return "3.1.2"; }
+  const char *getSdkVersion() { return "2.2.2-dev(38a443e)"; }
+  String getResetReason() { return "Power On"; }
+  uint32_t getChipId() { return 0x00C0FFEE; }
+  uint32_t getFlashChipId() { return 0x1640EF; }
+  uint32_t getFlashChipRealSize() { return 4194304; }
+  uint32_t getFlashChipSize() { return 4194304; }
+  uint32_t getSketchSize() { return sketchSize; }
+  uint32_t getFreeSketchSpace() { return 1600000; }
+  String getSketchMD5() { return sketchMD5; }
+  uint32_t getCycleCount() { return esp_get_cycle_count(); }
+  rst_info *getResetInfoPtr() { return &resetInfo; }
+  bool flashRead(uint32_t address, uint8_t *data, size_t size)
+  {
+    if (address + size > sizeof(flash)) return false;
+    memcpy(data, flash + address, size);
+    return true;
+  }
+  bool flashRead(uint32_t address, uint32_t *data, size_t size)
+  {
+    return flashRead(address, (uint8_t *)data, size);
+  }
+  // NOR flash: programming can only clear bits, erasing sets a whole sector
+  bool flashWrite(uint32_t address, const uint32_t *data, size_t size)
+  {
+    if (address % 4 || size % 4 || address + size > sizeof(flash)) {
+      return false;
+    }
+    const uint8_t *p = (const uint8_t *)data;
+    for (size_t i = 0; i < size; i++) flash[address + i] &= p[i];
+    flashWrites++;
+    return true;
+  }
+  bool flashEraseSector(uint32_t sector)
+  {
+    if ((sector + 1) * 4096 > sizeof(flash)) return false;
+    memset(flash + sector * 4096, 0xFF, 4096);
+    flashErases++;
+    return true;
+  }
+
+  rst_info resetInfo = {REASON_DEFAULT_RST, 0, 0, 0, 0, 0, 0};
+  uint32_t flashWrites = 0;
+  uint32_t flashErases = 0;
+  uint8_t flash[4 << 20] = {};  // The whole flash chip, sketch first
+};
+extern EspClass ESP;
+
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+
+using std::max;
+using std::min;
+#define constrain(amt, low, high) \
+  ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 38)
+inline size_t strlcpy(char *dst, const char *src, size_t size)
+{
+  size_t len = strlen(src);
+  if (size) {
+    size_t n = len < size - 1 ? len : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return len;
+}
+#endif
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <Arduino.h>
+
+typedef enum {
+  OTA_AUTH_ERROR,
+  OTA_BEGIN_ERROR,
+  OTA_CONNECT_ERROR,
+  OTA_RECEIVE_ERROR,
+  OTA_END_ERROR
+} ota_error_t;
+
+class ArduinoOTAClass
+{
+ public:
+  typedef std::function<void(void)> THandlerFunction;
+  typedef std::function<void(ota_error_t)> THandlerFunction_Error;
+  typedef std::function<void(unsigned int, unsigned int)>
+      THandlerFunction_Progress;
+
+  void setHostname(const char *) {}
+  void setPort(uint16_t) {}
+  void onStart(THandlerFunction fn) { start = fn; }
+  void onEnd(THandlerFunction fn) { end = fn; }
+  void onError(THandlerFunction_Error fn) { error = fn; }
+  void onProgress(THandlerFunction_Progress fn) { progress = fn; }
+  void begin(bool = true) {}
+  void handle() {}
+
+  // Replay an upload of the given size through the registered callbacks
+  void simulate(unsigned int size, unsigned int chunk = 1460);
+
+  THandlerFunction start, end;
+  THandlerFunction_Error error;
+  THandlerFunction_Progress progress;
+};
+extern ArduinoOTAClass ArduinoOTA;
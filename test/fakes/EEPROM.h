@@ -0,0 +1,40 @@
+#pragma once
+
+#include <Arduino.h>
+
+// RAM backed EEPROM emulation; contents survive "reboots" within a process
+class EEPROMClass
+{
+ public:
+  void begin(size_t size) { size_ = size; }
+  template <typename T>
+  T &get(int address, T &t)
+  {
+    memcpy(&t, data + address, sizeof(T));
+    return t;
+  }
+  template <typename T>
+  const T &put(int address, const T &t)
+  {
+    if (memcmp(data + address, &t, sizeof(T)) != 0) {
+      memcpy(data + address, &t, sizeof(T));
+      dirty_ = true;
+    }
+    return t;
+  }
+  bool commit()
+  {
+    if (dirty_) commits++;
+    dirty_ = false;
+    return true;
+  }
+  uint8_t *getDataPtr() { return data; }
+
+  uint8_t data[4096] = {};
+  uint32_t commits = 0;
+
+ private:
+  size_t size_ = 0;
+  bool dirty_ = false;
+};
+extern EEPROMClass EEPROM;
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <deque>
+#include <utility>
+#include <vector>
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT };
+enum HTTPUploadStatus {
+  UPLOAD_FILE_START,
+  UPLOAD_FILE_WRITE,
+  UPLOAD_FILE_END,
+  UPLOAD_FILE_ABORTED
+};
+
+struct HTTPUpload {
+  HTTPUploadStatus status = UPLOAD_FILE_START;
+  String filename;
+  size_t totalSize = 0;
+  size_t currentSize = 0;
+  uint8_t buf[2048];
+};
+
+namespace fake
+{
+struct HttpRequest {
+  HTTPMethod method = HTTP_GET;
+  String uri;
+  std::vector<std::pair<String, String>> args;
+  std::vector<uint8_t> body;  // File part for the upload handler, if any
+};
+
+struct HttpResponse {
+  int code = 0;
+  String contentType;
+  String content;
+};
+
+// When non-zero, begin() listens on this TCP port on localhost and
+// handleClient() serves real connections one at a time, blocking while a
+// request is read like the device's server does (see scripts/loadtest.py)
+extern uint16_t httpListenPort;
+}  // namespace fake
+
+class ESP8266WebServer
+{
+ public:
+  typedef std::function<void(void)> THandlerFunction;
+
+  explicit ESP8266WebServer(int port = 80) : port_(port) {}
+
+  void on(const String &uri, THandlerFunction fn)
+  {
+    routes_.push_back({uri, HTTP_ANY, fn, nullptr});
+  }
+  void on(const String &uri, HTTPMethod method, THandlerFunction fn)
+  {
+    routes_.push_back({uri, method, fn, nullptr});
+  }
+  void on(const String &uri, HTTPMethod method, THandlerFunction fn,
+          THandlerFunction upload)
+  {
+    routes_.push_back({uri, method, fn, upload});
+  }
+  void onNotFound(THandlerFunction fn) { notFound_ = fn; }
+  void begin();
+  void stop();
+  void close() { stop(); }
+  void handleClient();
+
+  void send(int code, const char *type, const String &content);
+  void send(int code, const String &type, const String &content)
+  {
+    send(code, type.c_str(), content);
+  }
+  void send_P(int code, const char *type, const char *content)
+  {
+    send(code, type, String(content));
+  }
+  void setContentLength(size_t) {}
+  void sendHeader(const String &, const String &, bool = false) {}
+  void sendContent(const String &content)
+  {
+    last.content += content;
+    contentBytes += content.length();
+  }
+  void sendContent(const char *content, size_t len)
+  {
+    last.content.concat(content, len);
+    contentBytes += len;
+  }
+
+  String uri() { return current_.uri; }
+  HTTPMethod method() { return current_.method; }
+  int args() { return current_.args.size(); }
+  String argName(int i) { return current_.args[i].first; }
+  String arg(int i) { return current_.args[i].second; }
+  String arg(const String &name);
+  bool hasArg(const String &name);
+  HTTPUpload &upload() { return upload_; }
+
+  // Queue a request for the next handleClient() call
+  std::deque<fake::HttpRequest> pending;
+  // Dispatch a request immediately and return the response
+  fake::HttpResponse request(const fake::HttpRequest &req);
+
+  fake::HttpResponse last;
+  uint64_t requests = 0;
+  uint64_t contentBytes = 0;
+
+ private:
+  struct Route {
+    String uri;
+    HTTPMethod method;
+    THandlerFunction fn;
+    THandlerFunction upload;
+  };
+  int port_;
+  bool running_ = false;
+  std::vector<Route> routes_;
+  THandlerFunction notFound_;
+  fake::HttpRequest current_;
+  HTTPUpload upload_;
+
+  int listenFd_ = -1;
+  int clientFd_ = -1;
+  uint32_t clientSince_ = 0;  // millis() the client was accepted
+  std::string rx_;
+  void serveSocket();
+  bool receive(size_t until, uint32_t timeout);
+  void closeClient();
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+enum wl_status_t { WL_IDLE_STATUS = 0, WL_CONNECTED = 3, WL_DISCONNECTED = 6 };
+enum WiFiSleepType_t { WIFI_NONE_SLEEP = 0, WIFI_LIGHT_SLEEP = 1, WIFI_MODEM_SLEEP = 2 };
+
+class ESP8266WiFiClass
+{
+ public:
+  wl_status_t connected = WL_CONNECTED;
+  IPAddress ip = IPAddress(192, 168, 0, 50);
+  WiFiSleepType_t sleepType = WIFI_NONE_SLEEP;
+  uint8_t listenInterval = 0;
+
+  wl_status_t status() { return connected; }
+  IPAddress localIP() { return connected == WL_CONNECTED ? ip : IPAddress(); }
+  IPAddress softAPIP() { return IPAddress(192, 168, 4, 1); }
+  String SSID() { return "fake-ssid"; }
+  int32_t RSSI() { return -60; }
+  int hostByName(const char *, IPAddress &result)
+  {
+    result = IPAddress(10, 0, 0, 123);
+    return connected == WL_CONNECTED;
+  }
+  bool hostname(const char *) { return true; }
+  bool disconnect(bool = false) { return true; }
+  bool setSleepMode(WiFiSleepType_t type, uint8_t interval = 0)
+  {
+    sleepType = type;
+    listenInterval = interval;
+    return true;
+  }
+  WiFiSleepType_t getSleepMode() { return sleepType; }
+};
+extern ESP8266WiFiClass WiFi;
+
+class WiFiClient
+{
+};
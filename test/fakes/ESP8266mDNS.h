@@ -0,0 +1,9 @@
+#pragma once
+
+class MDNSResponder
+{
+ public:
+  bool begin(const char *) { return true; }
+  bool update() { return true; }
+};
+extern MDNSResponder MDNS;
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+#include "WString.h"
+
+class IPAddress
+{
+ public:
+  IPAddress() = default;
+  IPAddress(uint32_t addr) : addr_(addr) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+      : addr_(a | (b << 8) | (c << 16) | ((uint32_t)d << 24))
+  {
+  }
+  operator uint32_t() const { return addr_; }
+  uint8_t operator[](int i) const { return (addr_ >> (8 * i)) & 0xFF; }
+  bool isSet() const { return addr_ != 0; }
+  String toString() const
+  {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1],
+             (*this)[2], (*this)[3]);
+    return String(buf);
+  }
+
+ private:
+  uint32_t addr_ = 0;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <Adafruit_GFX.h>
+
+class Max72xxPanel : public Adafruit_GFX
+{
+ public:
+  Max72xxPanel(uint8_t csPin, uint8_t hDisplays = 1, uint8_t vDisplays = 1)
+      : Adafruit_GFX(hDisplays << 3, vDisplays << 3)
+  {
+    (void)csPin;
+  }
+
+  void setPosition(uint8_t, uint8_t, uint8_t) {}
+  void setRotation(uint8_t, uint8_t) {}
+  void setRotation(uint8_t) {}
+  void shutdown(bool b) { isShutdown = b; }
+  void setIntensity(uint8_t i) { intensity = i; }
+  void fillScreen(uint16_t color) override
+  {
+    memset(bitmap, color ? 0xFF : 0, sizeof(bitmap));
+  }
+  void drawPixel(int16_t x, int16_t y, uint16_t color) override;
+  void write() { writes++; }
+  using Adafruit_GFX::write;
+
+  bool getPixel(int16_t x, int16_t y) const;
+
+  uint8_t bitmap[32 * 8 / 8] = {};
+  uint8_t intensity = 0;
+  bool isShutdown = false;
+  uint32_t writes = 0;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <vector>
+
+// Collects the "flashed" image in memory
+class UpdaterClass
+{
+ public:
+  bool begin(size_t size)
+  {
+    image.clear();
+    size_ = size;
+    running_ = true;
+    return true;
+  }
+  bool setMD5(const char *md5)
+  {
+    expectedMD5 = md5;
+    return true;
+  }
+  size_t write(uint8_t *data, size_t len)
+  {
+    image.insert(image.end(), data, data + len);
+    return len;
+  }
+  bool end(bool evenIfRemaining = false)
+  {
+    running_ = false;
+    return evenIfRemaining || image.size() == size_;
+  }
+  bool isRunning() { return running_; }
+
+  std::vector<uint8_t> image;
+  String expectedMD5;
+
+ private:
+  size_t size_ = 0;
+  bool running_ = false;
+};
+extern UpdaterClass Update;
@@ -0,0 +1,154 @@
+#pragma once
+
+// Minimal Arduino String built on std::string
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+class String
+{
+ public:
+  String() = default;
+  String(const char *s) : str_(s ? s : "") {}
+  String(const std::string &s) : str_(s) {}
+  String(char c) : str_(1, c) {}
+  String(int n, unsigned char base = 10) : String((long)n, base) {}
+  String(unsigned int n, unsigned char base = 10) : String((unsigned long)n, base) {}
+  String(long n, unsigned char base = 10)
+  {
+    if (base == 10) {
+      str_ = std::to_string(n);
+    } else {
+      *this = String((unsigned long)n, base);
+    }
+  }
+  String(unsigned long n, unsigned char base = 10)
+  {
+    char buf[33];
+    if (base == 16)
+      snprintf(buf, sizeof(buf), "%lx", n);
+    else
+      snprintf(buf, sizeof(buf), "%lu", n);
+    str_ = buf;
+  }
+  String(long long n) : str_(std::to_string(n)) {}
+  String(unsigned long long n) : str_(std::to_string(n)) {}
+  String(double n, unsigned char digits = 2)
+  {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", digits, n);
+    str_ = buf;
+  }
+  String(float n, unsigned char digits = 2) : String((double)n, digits) {}
+
+  const char *c_str() const { return str_.c_str(); }
+  unsigned int length() const { return str_.length(); }
+  bool isEmpty() const { return str_.empty(); }
+  bool reserve(unsigned int size)
+  {
+    str_.reserve(size);
+    return true;
+  }
+  char operator[](unsigned int i) const { return i < str_.size() ? str_[i] : 0; }
+  char &operator[](unsigned int i) { return str_[i]; }
+  char charAt(unsigned int i) const { return (*this)[i]; }
+
+  String &operator+=(const String &s)
+  {
+    str_ += s.str_;
+    return *this;
+  }
+  String &operator+=(const char *s)
+  {
+    str_ += s;
+    return *this;
+  }
+  String &operator+=(char c)
+  {
+    str_ += c;
+    return *this;
+  }
+  bool concat(const char *s, unsigned int len)
+  {
+    str_.append(s, len);
+    return true;
+  }
+  bool concat(const String &s)
+  {
+    str_ += s.str_;
+    return true;
+  }
+  bool operator==(const String &s) const { return str_ == s.str_; }
+  bool operator==(const char *s) const { return str_ == s; }
+  bool operator!=(const String &s) const { return str_ != s.str_; }
+  bool equals(const String &s) const { return str_ == s.str_; }
+  bool startsWith(const String &s) const { return str_.rfind(s.str_, 0) == 0; }
+
+  int indexOf(char c, unsigned int from = 0) const
+  {
+    size_t i = str_.find(c, from);
+    return i == std::string::npos ? -1 : (int)i;
+  }
+  int indexOf(const String &s, unsigned int from = 0) const
+  {
+    size_t i = str_.find(s.str_, from);
+    return i == std::string::npos ? -1 : (int)i;
+  }
+  String substring(unsigned int from) const
+  {
+    return from < str_.size() ? String(str_.substr(from)) : String();
+  }
+  String substring(unsigned int from, unsigned int to) const
+  {
+    if (from > to) std::swap(from, to);
+    if (from >= str_.size()) return String();
+    return String(str_.substr(from, to - from));
+  }
+  void replace(const String &find, const String &repl)
+  {
+    if (find.str_.empty()) return;
+    size_t pos = 0;
+    while ((pos = str_.find(find.str_, pos)) != std::string::npos) {
+      str_.replace(pos, find.str_.size(), repl.str_);
+      pos += repl.str_.size();
+    }
+  }
+  void toUpperCase()
+  {
+    std::transform(str_.begin(), str_.end(), str_.begin(), ::toupper);
+  }
+  void toLowerCase()
+  {
+    std::transform(str_.begin(), str_.end(), str_.begin(), ::tolower);
+  }
+  void trim()
+  {
+    size_t b = str_.find_first_not_of(" \t\r\n");
+    size_t e = str_.find_last_not_of(" \t\r\n");
+    str_ = b == std::string::npos ? "" : str_.substr(b, e - b + 1);
+  }
+  long toInt() const { return strtol(str_.c_str(), nullptr, 10); }
+  float toFloat() const { return strtof(str_.c_str(), nullptr); }
+
+  friend String operator+(const String &a, const String &b)
+  {
+    return String(a.str_ + b.str_);
+  }
+  friend String operator+(const String &a, const char *b)
+  {
+    return String(a.str_ + b);
+  }
+  friend String operator+(const char *a, const String &b)
+  {
+    return String(a + b.str_);
+  }
+  friend String operator+(const String &a, char b) { return String(a.str_ + b); }
+
+ private:
+  std::string str_;
+};
+
+typedef char __FlashStringHelper;
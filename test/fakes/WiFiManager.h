@@ -0,0 +1,17 @@
+#pragma once
+
+#include <Arduino.h>
+
+class WiFiManager
+{
+ public:
+  void setAPCallback(void (*fn)(WiFiManager *)) { apCallback_ = fn; }
+  void setConfigPortalTimeout(unsigned long) {}
+  void setDebugOutput(bool) {}
+  bool autoConnect(const char *) { return true; }
+  void resetSettings() {}
+  String getConfigPortalSSID() { return "NTP_Clock"; }
+
+ private:
+  void (*apCallback_)(WiFiManager *) = nullptr;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+#include <deque>
+#include <vector>
+
+namespace fake
+{
+struct Datagram {
+  IPAddress remote;
+  uint16_t remotePort = 0;
+  uint16_t localPort = 0;
+  std::vector<uint8_t> data;
+};
+
+// Packets waiting to be received by the firmware
+extern std::deque<Datagram> udpInbox;
+// Called for every packet the firmware sends
+extern std::function<void(const Datagram &)> onUdpSend;
+
+// A stratum 2 server's reply to request, transmit time unixMs
+Datagram ntpReply(const Datagram &request, uint64_t unixMs);
+}  // namespace fake
+
+class WiFiUDP
+{
+ public:
+  uint8_t begin(uint16_t port)
+  {
+    port_ = port;
+    return 1;
+  }
+  uint8_t beginMulticast(IPAddress, IPAddress, uint16_t port)
+  {
+    return begin(port);
+  }
+  void stop() { port_ = 0; }
+  uint16_t localPort() { return port_; }
+
+  int parsePacket();
+  int available() { return current_.data.size() - readPos_; }
+  int read(uint8_t *buf, size_t len);
+  int read(char *buf, size_t len) { return read((uint8_t *)buf, len); }
+  int read();
+  IPAddress remoteIP() { return current_.remote; }
+  uint16_t remotePort() { return current_.remotePort; }
+
+  int beginPacket(IPAddress ip, uint16_t port);
+  int beginPacketMulticast(IPAddress ip, uint16_t port, IPAddress)
+  {
+    return beginPacket(ip, port);
+  }
+  size_t write(const uint8_t *buf, size_t len);
+  size_t write(uint8_t c) { return write(&c, 1); }
+  int endPacket();
+
+ private:
+  uint16_t port_ = 0;
+  fake::Datagram current_;
+  size_t readPos_ = 0;
+  fake::Datagram outgoing_;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+// I2C bus fake with an MPU6050 register model at address 0x68. The register
+// file is plain memory, so tests can poke accelerometer/FIFO contents.
+
+#include <Arduino.h>
+
+#include <deque>
+
+namespace fake
+{
+struct Mpu6050 {
+  uint8_t regs[128] = {};
+  std::deque<uint8_t> fifo;
+  uint32_t transactions = 0;
+};
+extern Mpu6050 mpu;
+}  // namespace fake
+
+class TwoWire
+{
+ public:
+  void begin() {}
+  void begin(int, int) {}
+  void setClock(uint32_t) {}
+  void beginTransmission(uint8_t address);
+  size_t write(uint8_t data);
+  uint8_t endTransmission(bool stop = true);
+  uint8_t requestFrom(uint8_t address, size_t quantity, bool stop = true);
+  uint8_t requestFrom(uint8_t address, uint8_t quantity)
+  {
+    return requestFrom(address, (size_t)quantity, true);
+  }
+  uint8_t requestFrom(int address, int quantity, int stop)
+  {
+    return requestFrom((uint8_t)address, (size_t)quantity, (bool)stop);
+  }
+  int available() { return rxLen_ - rxPos_; }
+  int read() { return rxPos_ < rxLen_ ? rx_[rxPos_++] : -1; }
+
+ private:
+  uint8_t address_ = 0;
+  uint8_t reg_ = 0;
+  bool haveReg_ = false;
+  uint8_t rx_[256];
+  size_t rxLen_ = 0, rxPos_ = 0;
+};
+extern TwoWire Wire;
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <Arduino.h>
+
+// The fake esp_delay() polls its condition every ms, so there is no task to
+// resume
+inline void esp_schedule() {}
+
+// Delay for up to timeout_ms while blocked() returns true
+template <typename T>
+void esp_delay(uint32_t timeout_ms, T &&blocked)
+{
+  for (uint32_t ms = 0; ms < timeout_ms && blocked(); ms++) delay(1);
+}
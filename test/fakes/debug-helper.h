@@ -0,0 +1,9 @@
+#pragma once
+
+// Debug macros routed to the fake Serial (silent unless Serial.echo is set)
+
+#define DebugBegin(...) DEBUG_OI.begin(__VA_ARGS__)
+#define DebugInfo()
+#define DebugPrint(...) DEBUG_OI.print(__VA_ARGS__)
+#define DebugPrintln(...) DEBUG_OI.println(__VA_ARGS__)
+#define DebugPrintf(...) DEBUG_OI.printf(__VA_ARGS__)
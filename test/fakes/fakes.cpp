@@ -0,0 +1,675 @@
+// Implementations behind the host fakes in this directory, plus the global
+// objects the firmware expects the core and libraries to provide.
+
+#include <Adafruit_GFX.h>
+#include <Arduino.h>
+#include <ArduinoOTA.h>
+#include <EEPROM.h>
+#include <ESP8266WebServer.h>
+#include <ESP8266WiFi.h>
+#include <ESP8266mDNS.h>
+#include <Max72xxPanel.h>
+#include <Updater.h>
+#include <WiFiUdp.h>
+#include <Wire.h>
+#include <include/UdpContext.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <thread>
+
+HardwareSerial Serial;
+EspClass ESP;
+ESP8266WiFiClass WiFi;
+MDNSResponder MDNS;
+ArduinoOTAClass ArduinoOTA;
+EEPROMClass EEPROM;
+UpdaterClass Update;
+TwoWire Wire;
+
+namespace fake
+{
+uint8_t pinLevel[numPins] = {};
+std::deque<Datagram> udpInbox;
+std::function<void(const Datagram &)> onUdpSend;
+
+Datagram ntpReply(const Datagram &request, uint64_t unixMs)
+{
+  constexpr uint32_t unixOffset = 2208988800UL;  // 1900 to 1970 seconds
+  uint32_t seconds = unixMs / 1000 + unixOffset;
+  uint32_t fraction = ((unixMs % 1000) << 32) / 1000;
+
+  Datagram reply;
+  reply.remote = request.remote;
+  reply.remotePort = request.remotePort;
+  reply.localPort = request.localPort;
+  reply.data.assign(48, 0);
+  reply.data[0] = 0x24;  // LI 0, version 4, server
+  reply.data[1] = 2;     // stratum
+  for (int i = 0; i < 4; i++) {
+    reply.data[40 + i] = seconds >> (24 - 8 * i);
+    reply.data[44 + i] = fraction >> (24 - 8 * i);
+  }
+  return reply;
+}
+
+uint32_t yieldMicros = 10;  // Virtual cost of a yield()
+uint32_t (*freeHeapModel)() = nullptr;
+uint16_t httpListenPort = 0;
+
+namespace
+{
+struct Interrupt {
+  void (*isr)() = nullptr;
+  int mode = 0;
+};
+Interrupt interrupts[numPins];
+
+Mpu6050 makeMpu()
+{
+  Mpu6050 m;
+  m.regs[0x75] = 0x68;  // WHO_AM_I
+  m.regs[0x3F] = 0x40;  // ACCEL_ZOUT = +1g, lying flat
+  return m;
+}
+}  // namespace
+
+Mpu6050 mpu = makeMpu();
+
+Clock &clock()
+{
+  static Clock c;
+  return c;
+}
+
+// Current time, following the host clock in real time mode
+uint64_t now()
+{
+  Clock &c = clock();
+  if (c.realTime) {
+    using namespace std::chrono;
+    static const auto hostStart = steady_clock::now();
+    static const uint64_t base = c.micros;
+    c.micros = base + duration_cast<microseconds>(steady_clock::now() -
+                                                  hostStart)
+                          .count();
+  }
+  return c.micros;
+}
+
+void advance(uint64_t us)
+{
+  Clock &c = clock();
+  if (c.realTime) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+    return;
+  }
+  uint64_t until = c.micros + us;
+  if (c.onAdvance) c.onAdvance(until);
+  if (c.micros < until) c.micros = until;
+}
+
+void setPin(uint8_t pin, uint8_t level)
+{
+  if (pin >= numPins) return;
+  uint8_t previous = pinLevel[pin];
+  pinLevel[pin] = level;
+
+  const Interrupt &i = interrupts[pin];
+  if (!i.isr || previous == level) return;
+  if (i.mode == CHANGE || (i.mode == RISING && level) ||
+      (i.mode == FALLING && !level)) {
+    i.isr();
+  }
+}
+}  // namespace fake
+
+uint32_t millis() { return fake::now() / 1000; }
+uint32_t micros() { return fake::now(); }
+void delay(uint32_t ms) { fake::advance((uint64_t)ms * 1000); }
+void delayMicroseconds(uint32_t us) { fake::advance(us); }
+void yield() { fake::advance(fake::yieldMicros); }
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  if (pin < fake::numPins && mode == INPUT_PULLUP) fake::pinLevel[pin] = HIGH;
+}
+
+int digitalRead(uint8_t pin)
+{
+  return pin < fake::numPins ? fake::pinLevel[pin] : LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) { fake::setPin(pin, value); }
+
+void attachInterrupt(int pin, void (*isr)(), int mode)
+{
+  if (pin >= 0 && pin < fake::numPins) fake::interrupts[pin] = {isr, mode};
+}
+
+void detachInterrupt(int pin)
+{
+  if (pin >= 0 && pin < fake::numPins) fake::interrupts[pin] = {};
+}
+
+/*********************************************************************************************\
+ * I2C / MPU6050
+\*********************************************************************************************/
+
+namespace
+{
+constexpr uint8_t mpuAddress = 0x68;
+constexpr uint8_t regUserCtrl = 0x6A;
+constexpr uint8_t regFifoCountH = 0x72;
+constexpr uint8_t regFifoCountL = 0x73;
+constexpr uint8_t regFifoRW = 0x74;
+}  // namespace
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+  address_ = address;
+  haveReg_ = false;
+}
+
+size_t TwoWire::write(uint8_t data)
+{
+  if (address_ != mpuAddress) return 0;
+  if (!haveReg_) {
+    reg_ = data;
+    haveReg_ = true;
+    return 1;
+  }
+
+  if (reg_ == regFifoRW) {
+    fake::mpu.fifo.push_back(data);
+  } else {
+    if (reg_ == regUserCtrl && (data & 0x04)) fake::mpu.fifo.clear();
+    fake::mpu.regs[reg_ & 0x7F] = data;
+    reg_++;
+  }
+  return 1;
+}
+
+uint8_t TwoWire::endTransmission(bool)
+{
+  fake::mpu.transactions++;
+  return address_ == mpuAddress ? 0 : 2;  // 2: address NACK
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, size_t quantity, bool)
+{
+  rxLen_ = rxPos_ = 0;
+  if (address != mpuAddress) return 0;
+  fake::mpu.transactions++;
+
+  quantity = std::min(quantity, sizeof(rx_));
+  for (size_t i = 0; i < quantity; i++) {
+    uint16_t count = fake::mpu.fifo.size();
+    if (reg_ == regFifoRW) {
+      if (fake::mpu.fifo.empty()) {
+        rx_[rxLen_++] = 0;
+      } else {
+        rx_[rxLen_++] = fake::mpu.fifo.front();
+        fake::mpu.fifo.pop_front();
+      }
+      continue;  // FIFO reads don't auto-increment
+    }
+    if (reg_ == regFifoCountH) {
+      rx_[rxLen_++] = count >> 8;
+    } else if (reg_ == regFifoCountL) {
+      rx_[rxLen_++] = count & 0xFF;
+    } else {
+      rx_[rxLen_++] = fake::mpu.regs[reg_ & 0x7F];
+    }
+    reg_++;
+  }
+  return rxLen_;
+}
+
+/*********************************************************************************************\
+ * UDP
+\*********************************************************************************************/
+
+int WiFiUDP::parsePacket()
+{
+  current_ = fake::Datagram();
+  readPos_ = 0;
+  if (!port_ || WiFi.status() != WL_CONNECTED) return 0;
+
+  for (auto it = fake::udpInbox.begin(); it != fake::udpInbox.end(); ++it) {
+    if (it->localPort == 0 || it->localPort == port_) {
+      current_ = *it;
+      fake::udpInbox.erase(it);
+      return current_.data.size();
+    }
+  }
+  return 0;
+}
+
+int WiFiUDP::read(uint8_t *buf, size_t len)
+{
+  size_t n = std::min(len, current_.data.size() - readPos_);
+  memcpy(buf, current_.data.data() + readPos_, n);
+  readPos_ += n;
+  return n;
+}
+
+int WiFiUDP::read()
+{
+  return readPos_ < current_.data.size() ? current_.data[readPos_++] : -1;
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port)
+{
+  outgoing_ = fake::Datagram();
+  outgoing_.remote = ip;
+  outgoing_.remotePort = port;
+  outgoing_.localPort = port_;
+  return 1;
+}
+
+size_t WiFiUDP::write(const uint8_t *buf, size_t len)
+{
+  outgoing_.data.insert(outgoing_.data.end(), buf, buf + len);
+  return len;
+}
+
+int WiFiUDP::endPacket()
+{
+  if (WiFi.status() != WL_CONNECTED) return 0;
+  if (fake::onUdpSend) fake::onUdpSend(outgoing_);
+  return 1;
+}
+
+namespace
+{
+std::vector<UdpContext *> udpContexts;  // Live contexts, for udpArrive()
+}  // namespace
+
+UdpContext::UdpContext() { udpContexts.push_back(this); }
+
+UdpContext::~UdpContext()
+{
+  udpContexts.erase(
+      std::find(udpContexts.begin(), udpContexts.end(), this));
+}
+
+bool UdpContext::next()
+{
+  if (queue_.empty()) return false;
+  current_ = queue_.front();
+  queue_.pop_front();
+  readPos_ = 0;
+  return true;
+}
+
+size_t UdpContext::read(char *dst, size_t size)
+{
+  size_t n = std::min(size, getSize());
+  memcpy(dst, current_.data.data() + readPos_, n);
+  readPos_ += n;
+  return n;
+}
+
+size_t UdpContext::append(const char *data, size_t size)
+{
+  outgoing_.insert(outgoing_.end(), data, data + size);
+  return size;
+}
+
+bool UdpContext::send(const IPAddress &addr, uint16_t port)
+{
+  fake::Datagram d;
+  d.remote = addr;
+  d.remotePort = port;
+  d.localPort = port_;
+  d.data.swap(outgoing_);
+  if (WiFi.status() != WL_CONNECTED) return false;
+  if (fake::onUdpSend) fake::onUdpSend(d);
+  return true;
+}
+
+void UdpContext::receive(const fake::Datagram &d)
+{
+  queue_.push_back(d);
+  if (rx_) rx_();
+}
+
+void fake::udpArrive(const Datagram &d)
+{
+  for (UdpContext *ctx : udpContexts) {
+    if (ctx->getLocalPort() == d.localPort) {
+      ctx->receive(d);
+      return;
+    }
+  }
+  udpInbox.push_back(d);
+}
+
+/*********************************************************************************************\
+ * Web server
+\*********************************************************************************************/
+
+void ESP8266WebServer::begin()
+{
+  running_ = true;
+  if (!fake::httpListenPort || listenFd_ >= 0) return;
+
+  listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
+  int on = 1;
+  setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(fake::httpListenPort);
+  if (bind(listenFd_, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(listenFd_, 5) != 0) {  // lwIP's default backlog
+    perror("ESP8266WebServer: listen");
+    exit(1);
+  }
+  fcntl(listenFd_, F_SETFL, O_NONBLOCK);
+}
+
+void ESP8266WebServer::stop()
+{
+  running_ = false;
+  closeClient();
+  if (listenFd_ >= 0) ::close(listenFd_);
+  listenFd_ = -1;
+}
+
+void ESP8266WebServer::handleClient()
+{
+  if (listenFd_ >= 0) {
+    serveSocket();
+    return;
+  }
+  if (!running_ || pending.empty()) return;
+  fake::HttpRequest req = pending.front();
+  pending.pop_front();
+  request(req);
+}
+
+fake::HttpResponse ESP8266WebServer::request(const fake::HttpRequest &req)
+{
+  last = fake::HttpResponse();
+  if (!running_) return last;  // code 0: connection refused
+
+  current_ = req;
+  requests++;
+
+  for (const Route &route : routes_) {
+    if (!(route.uri == req.uri)) continue;
+    if (route.method != HTTP_ANY && route.method != req.method) continue;
+
+    // the real server only calls the upload handler for a multipart file
+    // part; a request without a body stands in for one that has none
+    if (route.upload && !req.body.empty()) {
+      upload_.filename = "upload.bin";
+      upload_.totalSize = 0;
+      upload_.currentSize = 0;
+      upload_.status = UPLOAD_FILE_START;
+      route.upload();
+
+      size_t pos = 0;
+      while (pos < req.body.size()) {
+        size_t n = std::min(sizeof(upload_.buf), req.body.size() - pos);
+        memcpy(upload_.buf, req.body.data() + pos, n);
+        upload_.currentSize = n;
+        upload_.totalSize += n;
+        upload_.status = UPLOAD_FILE_WRITE;
+        route.upload();
+        pos += n;
+      }
+      upload_.currentSize = 0;
+      upload_.status = UPLOAD_FILE_END;
+      route.upload();
+    }
+    route.fn();
+    return last;
+  }
+
+  if (notFound_) notFound_();
+  return last;
+}
+
+namespace
+{
+constexpr uint32_t httpMaxDataWait = 5000;  // ms for a client to start sending
+constexpr uint32_t httpMaxSendWait = 5000;  // ms per read once it has
+
+String urlDecode(const std::string &in)
+{
+  std::string out;
+  for (size_t i = 0; i < in.size(); i++) {
+    if (in[i] == '+') {
+      out += ' ';
+    } else if (in[i] == '%' && i + 2 < in.size()) {
+      out += (char)strtol(in.substr(i + 1, 2).c_str(), nullptr, 16);
+      i += 2;
+    } else {
+      out += in[i];
+    }
+  }
+  return String(out);
+}
+
+void parseArgs(const std::string &query, fake::HttpRequest &req)
+{
+  size_t pos = 0;
+  while (pos < query.size()) {
+    size_t end = query.find('&', pos);
+    if (end == std::string::npos) end = query.size();
+    std::string pair = query.substr(pos, end - pos);
+    size_t eq = pair.find('=');
+    if (!pair.empty()) {
+      req.args.push_back({urlDecode(pair.substr(0, eq)),
+                          eq == std::string::npos
+                              ? String()
+                              : urlDecode(pair.substr(eq + 1))});
+    }
+    pos = end + 1;
+  }
+}
+}  // namespace
+
+void ESP8266WebServer::closeClient()
+{
+  if (clientFd_ >= 0) ::close(clientFd_);
+  clientFd_ = -1;
+  rx_.clear();
+}
+
+// Read what has arrived, waiting up to timeout ms for rx_ to grow past
+// `until` bytes; false if the client went away or timed out
+bool ESP8266WebServer::receive(size_t until, uint32_t timeout)
+{
+  uint32_t start = millis();
+  while (rx_.size() <= until) {
+    int32_t left = timeout - (millis() - start);
+    pollfd p = {clientFd_, POLLIN, 0};
+    if (poll(&p, 1, left > 0 ? left : 0) <= 0) return false;
+
+    char buf[1460];
+    ssize_t n = recv(clientFd_, buf, sizeof(buf), 0);
+    if (n <= 0) return false;
+    rx_.append(buf, n);
+  }
+  return true;
+}
+
+void ESP8266WebServer::serveSocket()
+{
+  if (clientFd_ < 0) {
+    clientFd_ = accept(listenFd_, nullptr, nullptr);
+    if (clientFd_ < 0) return;
+    clientSince_ = millis();
+  }
+
+  // like the real server, wait across loops for the first bytes...
+  if (rx_.empty() && !receive(0, 0)) {
+    if (millis() - clientSince_ > httpMaxDataWait) closeClient();
+    return;
+  }
+
+  // ...then read the rest of the request in one go, blocking the loop
+  size_t headerEnd;
+  while ((headerEnd = rx_.find("\r\n\r\n")) == std::string::npos) {
+    if (!receive(rx_.size(), httpMaxSendWait)) return closeClient();
+  }
+
+  fake::HttpRequest req;
+  std::string head = rx_.substr(0, headerEnd);
+  std::string method = head.substr(0, head.find(' '));
+  size_t uriStart = method.size() + 1;
+  std::string target = head.substr(uriStart, head.find(' ', uriStart) - uriStart);
+  req.method = method == "POST"  ? HTTP_POST
+               : method == "PUT" ? HTTP_PUT
+               : method == "HEAD" ? HTTP_HEAD
+                                  : HTTP_GET;
+  size_t query = target.find('?');
+  req.uri = String(target.substr(0, query));
+  if (query != std::string::npos) parseArgs(target.substr(query + 1), req);
+
+  size_t contentLength = 0;
+  bool form = false;
+  std::string lower = head;
+  std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+  size_t cl = lower.find("\r\ncontent-length:");
+  if (cl != std::string::npos) contentLength = atol(lower.c_str() + cl + 17);
+  form = lower.find("application/x-www-form-urlencoded") != std::string::npos;
+
+  size_t total = headerEnd + 4 + contentLength;
+  if (rx_.size() < total && !receive(total - 1, httpMaxSendWait)) {
+    return closeClient();
+  }
+  std::string body = rx_.substr(headerEnd + 4, contentLength);
+  if (form) {
+    parseArgs(body, req);
+  } else {
+    req.body.assign(body.begin(), body.end());
+  }
+
+  fake::HttpResponse res = request(req);
+  std::string out = "HTTP/1.1 " + std::to_string(res.code) + " OK\r\n" +
+                    "Content-Type: " + res.contentType.c_str() + "\r\n" +
+                    "Content-Length: " +
+                    std::to_string(res.content.length()) + "\r\n" +
+                    "Connection: close\r\n\r\n" + res.content.c_str();
+  for (size_t sent = 0; sent < out.size();) {
+    ssize_t n = ::send(clientFd_, out.data() + sent, out.size() - sent,
+                       MSG_NOSIGNAL);
+    if (n <= 0) break;
+    sent += n;
+  }
+  closeClient();
+}
+
+void ESP8266WebServer::send(int code, const char *type, const String &content)
+{
+  last.code = code;
+  last.contentType = type;
+  last.content = content;
+  contentBytes += content.length();
+}
+
+String ESP8266WebServer::arg(const String &name)
+{
+  for (const auto &a : current_.args) {
+    if (a.first == name) return a.second;
+  }
+  return String();
+}
+
+bool ESP8266WebServer::hasArg(const String &name)
+{
+  for (const auto &a : current_.args) {
+    if (a.first == name) return true;
+  }
+  return false;
+}
+
+/*********************************************************************************************\
+ * OTA
+\*********************************************************************************************/
+
+void ArduinoOTAClass::simulate(unsigned int size, unsigned int chunk)
+{
+  if (start) start();
+  for (unsigned int done = 0; done < size;) {
+    done = std::min(size, done + chunk);
+    delay(1);  // ~1.4MB/s, roughly what the radio manages at best
+    if (progress) progress(done, size);
+  }
+  if (end) end();
+}
+
+/*********************************************************************************************\
+ * Graphics
+\*********************************************************************************************/
+
+void Adafruit_GFX::fillScreen(uint16_t color)
+{
+  for (int16_t y = 0; y < height_; y++) {
+    for (int16_t x = 0; x < width_; x++) drawPixel(x, y, color);
+  }
+}
+
+void Adafruit_GFX::drawChar(int16_t x, int16_t y, unsigned char c,
+                            uint16_t color, uint16_t bg, uint8_t size)
+{
+  // 5x7 glyph with a pattern derived from the character code, plus the
+  // blank spacing column, drawn pixel by pixel like the real renderer
+  for (int8_t col = 0; col < 6; col++) {
+    uint8_t line = col < 5 ? (uint8_t)(c * (col + 3)) & 0x7F : 0;
+    for (int8_t row = 0; row < 8; row++, line >>= 1) {
+      uint16_t pixel = (line & 1) ? color : bg;
+      if (pixel == bg && bg == color) continue;
+      for (uint8_t sx = 0; sx < size; sx++) {
+        for (uint8_t sy = 0; sy < size; sy++) {
+          drawPixel(x + col * size + sx, y + row * size + sy, pixel);
+        }
+      }
+    }
+  }
+}
+
+size_t Adafruit_GFX::write(uint8_t c)
+{
+  if (c == '\n') {
+    cursorX_ = 0;
+    cursorY_ += textSize_ * 8;
+  } else if (c != '\r') {
+    if (wrap_ && cursorX_ + textSize_ * 6 > width_) {
+      cursorX_ = 0;
+      cursorY_ += textSize_ * 8;
+    }
+    drawChar(cursorX_, cursorY_, c, textColor_, !textColor_, textSize_);
+    cursorX_ += textSize_ * 6;
+  }
+  return 1;
+}
+
+void Max72xxPanel::drawPixel(int16_t x, int16_t y, uint16_t color)
+{
+  if (x < 0 || y < 0 || x >= width_ || y >= height_) return;
+  size_t bit = y * width_ + x;
+  if (bit / 8 >= sizeof(bitmap)) return;
+  if (color) {
+    bitmap[bit / 8] |= 1 << (bit % 8);
+  } else {
+    bitmap[bit / 8] &= ~(1 << (bit % 8));
+  }
+}
+
+bool Max72xxPanel::getPixel(int16_t x, int16_t y) const
+{
+  if (x < 0 || y < 0 || x >= width_ || y >= height_) return false;
+  size_t bit = y * width_ + x;
+  return bit / 8 < sizeof(bitmap) && (bitmap[bit / 8] >> (bit % 8)) & 1;
+}
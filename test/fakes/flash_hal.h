@@ -0,0 +1,8 @@
+#pragma once
+
+// Flash layout of a 4 MB board with a 1 MB filesystem (eagle.flash.4m1m.ld)
+
+#define FLASH_SECTOR_SIZE 0x1000
+#define FLASH_BLOCK_SIZE 0x10000
+#define FS_PHYS_ADDR 0x2FB000
+#define FS_PHYS_SIZE 0xFA000
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <WiFiUdp.h>  // fake::Datagram
+
+#include <deque>
+
+// The core's lwIP UDP wrapper that WiFiUDP and ArduinoOTA are built on.
+// Unlike WiFiUDP it calls back as each packet arrives; here that happens
+// inside fake::udpArrive(), so in virtual time too.
+class UdpContext
+{
+ public:
+  typedef std::function<void(void)> rxhandler_t;
+
+  UdpContext();
+  ~UdpContext();
+
+  void ref() { refs_++; }
+  void unref()
+  {
+    if (--refs_ <= 0) delete this;
+  }
+
+  bool listen(const IPAddress &, uint16_t port)
+  {
+    port_ = port;
+    return true;
+  }
+  void setMulticastTTL(int) {}
+  void onRx(rxhandler_t handler) { rx_ = handler; }
+
+  bool next();
+  size_t getSize() const { return current_.data.size() - readPos_; }
+  size_t read(char *dst, size_t size);
+  IPAddress getRemoteAddress() const { return current_.remote; }
+  uint16_t getLocalPort() const { return port_; }
+
+  size_t append(const char *data, size_t size);
+  bool send(const IPAddress &addr, uint16_t port);
+
+  // Queue a datagram and run the receive handler (fake::udpArrive)
+  void receive(const fake::Datagram &d);
+
+ private:
+  int refs_ = 0;
+  uint16_t port_ = 0;
+  rxhandler_t rx_;
+  std::deque<fake::Datagram> queue_;
+  fake::Datagram current_;
+  size_t readPos_ = 0;
+  std::vector<uint8_t> outgoing_;
+};
+
+namespace fake
+{
+// A datagram arriving now: handed to any UdpContext listening on its local
+// port, otherwise queued in udpInbox for WiFiUDP
+void udpArrive(const Datagram &d);
+}  // namespace fake
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <IPAddress.h>
+
+typedef int8_t err_t;
+constexpr err_t ERR_OK = 0;
+
+// Group membership isn't modelled: every UdpContext sees every datagram
+// addressed to its port (see fake::udpArrive)
+inline err_t igmp_joingroup(const IPAddress &, const IPAddress &)
+{
+  return ERR_OK;
+}
+inline err_t igmp_leavegroup(const IPAddress &, const IPAddress &)
+{
+  return ERR_OK;
+}
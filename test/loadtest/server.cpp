@@ -0,0 +1,79 @@
+/**
+ * Stand-in clock for scripts/loadtest.py: runs the real setup() / loop()
+ * from src/main.cpp in real time, with the web server on a localhost port
+ * (pio run -e native-loadtest, then .pio/build/native-loadtest/program [port])
+ *
+ * Requests are served one at a time from loop() exactly as on the device, so
+ * queueing and slow clients stall the clock the same way. NTP is answered
+ * from the host's clock. Free heap is modelled from the bytes the firmware
+ * and fakes have allocated since setup() finished, against a nominal device
+ * heap; fragmentation and largest free block are fixed, so use a real device
+ * for those.
+ */
+
+#include <main.cpp>  // The firmware itself, setup() and loop()
+
+#include <malloc.h>
+
+#include <chrono>
+#include <new>
+
+namespace
+{
+constexpr uint32_t deviceHeap = 40000;  // Typical free heap after setup()
+
+size_t liveBytes = 0;
+size_t liveAtBoot = 0;
+
+uint32_t modelFreeHeap()
+{
+  int64_t used = (int64_t)liveBytes - liveAtBoot;
+  return used > (int64_t)deviceHeap ? 0 : deviceHeap - used;
+}
+
+void ntpServer(const fake::Datagram &request)
+{
+  if (request.remotePort != 123) return;
+
+  using namespace std::chrono;
+  uint64_t unixMs =
+      duration_cast<milliseconds>(system_clock::now().time_since_epoch())
+          .count();
+  fake::udpInbox.push_back(fake::ntpReply(request, unixMs));
+}
+}  // namespace
+
+// Count what the firmware allocates (GCC can't see that these pair up)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void *operator new(size_t size)
+{
+  void *p = malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  liveBytes += malloc_usable_size(p);
+  return p;
+}
+
+void operator delete(void *p) noexcept
+{
+  if (!p) return;
+  liveBytes -= malloc_usable_size(p);
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept { operator delete(p); }
+
+int main(int argc, char **argv)
+{
+  fake::httpListenPort = argc > 1 ? atoi(argv[1]) : 8080;
+  fake::clock().realTime = true;
+  fake::onUdpSend = ntpServer;
+
+  setup();
+  liveAtBoot = liveBytes;
+  fake::freeHeapModel = modelFreeHeap;
+  printf("Serving on http://127.0.0.1:%u\n", fake::httpListenPort);
+  fflush(stdout);
+
+  while (true) loop();
+}
@@ -0,0 +1,502 @@
+/**
+ * Virtual time simulator: runs the real setup() / loop() from src/main.cpp
+ * against the host fakes, fast-forwarding through days of uptime
+ * (pio run -e native-sim -t exec, or .pio/build/native-sim/program [options])
+ *
+ * The device's millis() starts shortly before the 49.7 day wrap. Scripted
+ * events (WiFi drops, NTP replies with delay / jitter / loss, a drifting
+ * crystal, button presses and HTTP requests) are delivered from an event
+ * queue whenever the firmware blocks in delay() / yield().
+ *
+ * Options (defaults in brackets):
+ *   --days N           simulated duration [7]
+ *   --drift PPM        device crystal error, positive runs fast [40]
+ *   --ntp-delay MS     NTP round trip [30]
+ *   --ntp-jitter MS    extra random delay on the return leg [20]
+ *   --ntp-loss P       probability an NTP reply is lost [0.05]
+ *   --wifi-every H     hours between WiFi drops, 0 for none [12]
+ *   --wifi-for S       length of each drop [90]
+ *   --button-every S   seconds between button presses, 0 for none [3600]
+ *   --http-every S     seconds between HTTP requests, 0 for none [5]
+ *   --wrap-in S        seconds of uptime before millis() wraps [600]
+ *   --power-mode N     sleep::PowerMode to run in [0, normal]
+ *   --beacon-every S   seconds between LAN beacons from a perfect leader,
+ *                      0 for none (the device runs with the beacon off) [0]
+ *   --beacon-delay MS  delivery delay of each beacon [2]
+ *   --beacon-jitter MS extra random delay, e.g. DTIM buffering [100]
+ *   --leader-id N      chip ID of that leader; above the device's (0xC0FFEE)
+ *                      the device should ignore it once NTP has synced [1]
+ *   --leader-stop H    hours after boot the leader falls silent, 0 never [0]
+ *   --leader-return H  hours after boot it starts again, 0 never [0]
+ *   --seed N           random seed [1]
+ */
+
+#include <main.cpp>  // The firmware itself, setup() and loop()
+
+#include <chrono>
+#include <map>
+#include <queue>
+#include <random>
+#include <vector>
+
+namespace sim
+{
+struct Options {
+  double days = 7;
+  double driftPpm = 40;
+  double ntpDelayMs = 30;
+  double ntpJitterMs = 20;
+  double ntpLoss = 0.05;
+  double wifiEveryH = 12;
+  double wifiForS = 90;
+  double buttonEveryS = 3600;
+  double httpEveryS = 5;
+  double wrapInS = 600;
+  double powerMode = sleep::POWER_NORMAL;
+  double beaconEveryS = 0;
+  double beaconDelayMs = 2;
+  double beaconJitterMs = 100;
+  double leaderId = 1;
+  double leaderStopH = 0;
+  double leaderReturnH = 0;
+  uint32_t seed = 1;
+};
+
+Options options;
+std::mt19937 rng;
+
+// True UTC at the moment the device booted
+constexpr uint64_t trueEpochMs = 1718000000000ULL;
+uint64_t bootMicros = 0;
+
+double uniform() { return std::uniform_real_distribution<double>(0, 1)(rng); }
+
+uint64_t now() { return fake::clock().micros; }
+
+// True UTC for a device clock reading, given the crystal error
+double trueUtcMs(uint64_t deviceMicros)
+{
+  double elapsedMs = (deviceMicros - bootMicros) / 1000.0;
+  return trueEpochMs + elapsedMs / (1 + options.driftPpm * 1e-6);
+}
+
+/*********************************************************************************************\
+ * Event queue
+\*********************************************************************************************/
+
+struct Event {
+  uint64_t at;
+  uint64_t seq;  // FIFO among events due at the same time
+  std::function<void()> fn;
+  bool operator>(const Event &o) const
+  {
+    return at != o.at ? at > o.at : seq > o.seq;
+  }
+};
+
+std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+uint64_t eventSeq = 0;
+
+void schedule(uint64_t at, std::function<void()> fn)
+{
+  events.push({at, eventSeq++, std::move(fn)});
+}
+
+void every(double seconds, std::function<void()> fn)
+{
+  if (seconds <= 0) return;
+  schedule(now() + (uint64_t)(seconds * 1e6), [=] {
+    fn();
+    every(seconds, fn);
+  });
+}
+
+// Deliver events that fall due while the firmware blocks
+void deliver(uint64_t until)
+{
+  while (!events.empty() && events.top().at <= until) {
+    Event e = events.top();
+    events.pop();
+    if (fake::clock().micros < e.at) fake::clock().micros = e.at;
+    e.fn();
+  }
+}
+
+/*********************************************************************************************\
+ * Statistics
+\*********************************************************************************************/
+
+struct Stats {
+  std::vector<double> samples;
+  void add(double v) { samples.push_back(v); }
+  double percentile(double p)
+  {
+    if (samples.empty()) return 0;
+    std::sort(samples.begin(), samples.end());
+    return samples[std::min(samples.size() - 1,
+                            (size_t)(p / 100 * samples.size()))];
+  }
+  double mean()
+  {
+    double sum = 0;
+    for (double v : samples) sum += v;
+    return samples.empty() ? 0 : sum / samples.size();
+  }
+  double max() { return percentile(100); }
+};
+
+struct Report {
+  uint64_t loops = 0;
+  Stats hostLoopNs;     // Host CPU time per loop()
+  Stats loopMs;         // Virtual duration of each loop(), sleep included
+  Stats displayLateMs;  // Device time past the second boundary at redraw
+  Stats clockErrorMs;   // |device UTC - true UTC| at each redraw
+  uint64_t seconds = 0;         // Display redraws
+  uint64_t missedSeconds = 0;   // Seconds never shown
+  uint64_t steppedSeconds = 0;  // Skipped / repeated by NTP steps
+  uint64_t ntpRequests = 0;
+  uint64_t ntpReplies = 0;
+  int32_t maxStepMs = 0;
+  uint64_t wifiDrops = 0;
+  double wifiDownS = 0;
+  uint64_t restarts = 0;  // Times the firmware asked to reboot
+  uint64_t buttonPresses = 0;
+  uint64_t httpRequests = 0;
+  uint64_t httpServed = 0;
+  Stats httpLatencyMs;
+  uint64_t beaconsSent = 0;
+  std::string roles;          // Device's beacon role changes, "role@seconds"
+  double takeoverS = -1;      // Leader's last beacon to our first
+  double standDownS = -1;     // Leader's return to our following it
+};
+
+Report report;
+std::deque<uint64_t> httpQueued;  // Enqueue times of requests not yet served
+bool wasRestarting = false;       // Previous loop asked for a reboot
+uint32_t restarts = 0;            // ESP.restart() calls seen so far
+time_t shownUtc = 0;              // UTC second on the display
+int64_t clockOffset = 0;          // Time core offset at the last loop
+bool stepPending = false;         // Clock was set since the last redraw
+
+/*********************************************************************************************\
+ * Scripted world
+\*********************************************************************************************/
+
+void ntpServer(const fake::Datagram &request)
+{
+  if (request.remotePort != 123) return;
+  report.ntpRequests++;
+  if (uniform() < options.ntpLoss) return;
+
+  uint64_t outbound = options.ntpDelayMs * 500;
+  uint64_t inbound = outbound + options.ntpJitterMs * 1000 * uniform();
+  uint64_t sent = now();
+
+  schedule(sent + outbound, [=] {
+    // server stamps its (true) time as the request arrives
+    fake::Datagram reply = fake::ntpReply(request, trueUtcMs(now()));
+    schedule(now() + inbound - outbound, [=] {
+      report.ntpReplies++;
+      fake::udpInbox.push_back(reply);
+    });
+  });
+}
+
+void wifiDrop()
+{
+  report.wifiDrops++;
+  report.wifiDownS += options.wifiForS;
+  WiFi.connected = WL_DISCONNECTED;
+  fake::udpInbox.clear();
+  schedule(now() + options.wifiForS * 1e6,
+           [] { WiFi.connected = WL_CONNECTED; });
+}
+
+uint64_t leaderHeardAt = 0;    // Arrival of the scripted leader's last beacon
+uint64_t leaderReturnAt = 0;   // Arrival of its first beacon after a silence
+const char *role = "off";      // Device's beacon role at the last loop
+
+// A leader with the true time, silent between --leader-stop and
+// --leader-return
+void beaconLeader()
+{
+  if (WiFi.status() != WL_CONNECTED) return;
+  double hours = (now() - bootMicros) / 3600e6;
+  bool silent = options.leaderStopH > 0 && hours >= options.leaderStopH &&
+                (options.leaderReturnH <= 0 || hours < options.leaderReturnH);
+  if (silent) return;
+
+  report.beaconsSent++;
+  beacon::Packet packet = {beacon::MAGIC, (uint32_t)options.leaderId,
+                           (uint64_t)trueUtcMs(now())};
+  uint64_t delay =
+      (options.beaconDelayMs + options.beaconJitterMs * uniform()) * 1000;
+
+  fake::Datagram d;
+  d.remote = IPAddress(192, 168, 1, 2);
+  d.remotePort = beacon::port;
+  d.localPort = beacon::port;
+  d.data.assign((uint8_t *)&packet, (uint8_t *)(&packet + 1));
+  schedule(now() + delay, [=] {
+    if (WiFi.status() != WL_CONNECTED) return;
+    // first beacon after the scripted silence
+    bool gap = now() - leaderHeardAt > options.beaconEveryS * 2e6;
+    if (gap && options.leaderStopH > 0 && !leaderReturnAt &&
+        (now() - bootMicros) / 3600e6 >= options.leaderStopH) {
+      leaderReturnAt = now();
+    }
+    leaderHeardAt = now();
+    fake::udpArrive(d);
+  });
+}
+
+// Log the device's role as it changes, timing takeover and stand down
+void observeBeacon()
+{
+  const char *current = "off";
+  if (beacon::leading()) {
+    current = "leading";
+  } else if (beacon::following()) {
+    current = "following";
+  } else if (beacon::enabled) {
+    current = "listening";
+  }
+  if (current == role) return;
+
+  if (!strcmp(current, "leading") && options.leaderStopH > 0 &&
+      leaderHeardAt && report.takeoverS < 0) {
+    report.takeoverS = (now() - leaderHeardAt) / 1e6;
+  }
+  if (!strcmp(role, "leading") && !strcmp(current, "following") &&
+      leaderReturnAt) {
+    report.standDownS = (now() - leaderReturnAt) / 1e6;
+  }
+  role = current;
+  char entry[32];
+  snprintf(entry, sizeof(entry), "%s%s@%.0f", report.roles.empty() ? "" : " ",
+           role, (now() - bootMicros) / 1e6);
+  report.roles += entry;
+}
+
+void buttonPress()
+{
+  report.buttonPresses++;
+  fake::setPin(BUTTON_PIN, LOW);
+  schedule(now() + 120000, [] { fake::setPin(BUTTON_PIN, HIGH); });
+}
+
+void httpRequest()
+{
+  if (WiFi.status() != WL_CONNECTED) return;
+  fake::HttpRequest req;
+  req.uri = report.httpRequests % 10 ? "/getTimedate" : "/info";
+  report.httpRequests++;
+  webserver::webserver.pending.push_back(req);
+  httpQueued.push_back(now());
+}
+
+/*********************************************************************************************\
+ * Run
+\*********************************************************************************************/
+
+void parseOptions(int argc, char **argv)
+{
+  const std::map<std::string, double *> numeric = {
+      {"--days", &options.days},
+      {"--drift", &options.driftPpm},
+      {"--ntp-delay", &options.ntpDelayMs},
+      {"--ntp-jitter", &options.ntpJitterMs},
+      {"--ntp-loss", &options.ntpLoss},
+      {"--wifi-every", &options.wifiEveryH},
+      {"--wifi-for", &options.wifiForS},
+      {"--button-every", &options.buttonEveryS},
+      {"--http-every", &options.httpEveryS},
+      {"--wrap-in", &options.wrapInS},
+      {"--power-mode", &options.powerMode},
+      {"--beacon-every", &options.beaconEveryS},
+      {"--beacon-delay", &options.beaconDelayMs},
+      {"--beacon-jitter", &options.beaconJitterMs},
+      {"--leader-id", &options.leaderId},
+      {"--leader-stop", &options.leaderStopH},
+      {"--leader-return", &options.leaderReturnH},
+  };
+  for (int i = 1; i + 1 < argc; i += 2) {
+    auto it = numeric.find(argv[i]);
+    if (it != numeric.end()) {
+      *it->second = atof(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--seed")) {
+      options.seed = atoi(argv[i + 1]);
+    } else {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      exit(2);
+    }
+  }
+}
+
+// Record what one loop() did to the display and the outside world
+void observe(uint64_t loopStart, uint64_t hostNs)
+{
+  report.loops++;
+  report.hostLoopNs.add(hostNs);
+  observeBeacon();
+  report.loopMs.add((now() - loopStart) / 1000.0);
+
+  if (timekeeping::utcOffsetMs != clockOffset) {
+    if (timekeeping::isSet() && clockOffset) {
+      report.maxStepMs = std::max(report.maxStepMs, abs(timekeeping::lastStepMs));
+    }
+    clockOffset = timekeeping::utcOffsetMs;
+    // a set clears lastUtc; beacon nudges (adjustMillis()) don't count
+    if (!timekeeping::lastUtc) stepPending = true;
+  }
+
+  // lastUtc is 0 between a clock step and the next tick
+  time_t utc = timekeeping::lastUtc;
+  if (utc && utc != shownUtc) {
+    // tick() runs first thing in loop(), so judge the redraw at loopStart
+    double deviceMs = timekeeping::utcMillis() - (now() - loopStart) / 1000.0;
+    report.seconds++;
+    report.displayLateMs.add(deviceMs - utc * 1000.0);
+    report.clockErrorMs.add(fabs(deviceMs - trueUtcMs(loopStart)));
+
+    if (shownUtc && utc != shownUtc + 1) {
+      uint64_t skipped = utc > shownUtc ? utc - shownUtc - 1 : 1;
+      if (stepPending) {
+        report.steppedSeconds += skipped;
+      } else {
+        report.missedSeconds += skipped;
+      }
+    }
+    shownUtc = utc;
+    stepPending = false;
+  }
+
+  uint64_t served = webserver::webserver.requests - report.httpServed;
+  for (; served && !httpQueued.empty(); served--) {
+    report.httpLatencyMs.add((now() - httpQueued.front()) / 1000.0);
+    httpQueued.pop_front();
+    report.httpServed++;
+  }
+
+  // the fake ESP.restart() returns, so the loop keeps asking while the
+  // condition holds; count each run of requests as one reboot
+  bool restarting = ESP.restarts != restarts;
+  if (restarting && !wasRestarting) report.restarts++;
+  wasRestarting = restarting;
+  restarts = ESP.restarts;
+}
+
+void print()
+{
+  double simulatedS = (now() - bootMicros) / 1e6;
+  printf("Simulated %.1f days, %llu loops, millis() now %u\n",
+         simulatedS / 86400, (unsigned long long)report.loops, millis());
+
+  printf("\nTiming\n");
+  printf("  display redraws      %llu of %.0f seconds\n",
+         (unsigned long long)report.seconds, simulatedS);
+  printf("  missed seconds       %llu\n",
+         (unsigned long long)report.missedSeconds);
+  printf("  skipped by NTP step  %llu\n",
+         (unsigned long long)report.steppedSeconds);
+  printf("  redraw late (ms)     mean %.1f  p99 %.1f  max %.1f\n",
+         report.displayLateMs.mean(), report.displayLateMs.percentile(99),
+         report.displayLateMs.max());
+  printf("  clock error (ms)     mean %.1f  p99 %.1f  max %.1f\n",
+         report.clockErrorMs.mean(), report.clockErrorMs.percentile(99),
+         report.clockErrorMs.max());
+
+  printf("\nLoop\n");
+  printf("  host cost (ns)       mean %.0f  p99 %.0f  max %.0f\n",
+         report.hostLoopNs.mean(), report.hostLoopNs.percentile(99),
+         report.hostLoopNs.max());
+  printf("  period (ms)          mean %.1f  p99 %.1f  max %.1f\n",
+         report.loopMs.mean(), report.loopMs.percentile(99),
+         report.loopMs.max());
+  printf("  loop_load_avg        %u\n", loop_load_avg);
+
+  printf("\nNTP\n");
+  printf("  requests / replies   %llu / %llu\n",
+         (unsigned long long)report.ntpRequests,
+         (unsigned long long)report.ntpReplies);
+  printf("  largest step (ms)    %d\n", report.maxStepMs);
+  const wifi::NtpSummary &ntp = wifi::ntpSummary;
+  printf("  device summary       %u attempts, %u failed, jitter %u ms, "
+         "drift %d ppm\n",
+         ntp.attempts, ntp.failures, ntp.jitter, ntp.driftPpm);
+
+  printf("\nWiFi\n");
+  printf("  drops                %llu, %.0f s down\n",
+         (unsigned long long)report.wifiDrops, report.wifiDownS);
+  printf("  restarts             %llu\n", (unsigned long long)report.restarts);
+
+  printf("\nInput\n");
+  printf("  button presses       %llu\n",
+         (unsigned long long)report.buttonPresses);
+  printf("  HTTP served          %llu of %llu\n",
+         (unsigned long long)report.httpServed,
+         (unsigned long long)report.httpRequests);
+  printf("  HTTP latency (ms)    mean %.1f  p99 %.1f  max %.1f\n",
+         report.httpLatencyMs.mean(), report.httpLatencyMs.percentile(99),
+         report.httpLatencyMs.max());
+
+  printf("\nJournal\n");
+  printf("  records              %u held, %u still in RAM, %u dropped\n",
+         journal::recordCount(), journal::pendingCount, journal::dropped);
+  printf("  flash                %u page writes, %u sector erases\n",
+         ESP.flashWrites, ESP.flashErases);
+
+  if (options.beaconEveryS > 0) {
+    printf("\nBeacon\n");
+    printf("  sent / received      %llu / %u\n",
+           (unsigned long long)report.beaconsSent, beacon::received);
+    printf("  state                %s, last correction %d ms\n",
+           beacon::following() ? "following" : "not following",
+           beacon::lastOffset);
+    printf("  device announcements %u\n", beacon::sent);
+    printf("  roles (s)            %s\n", report.roles.c_str());
+    if (report.takeoverS >= 0) {
+      printf("  took over after      %.1f s of silence\n", report.takeoverS);
+    }
+    if (report.standDownS >= 0) {
+      printf("  stood down after     %.1f s\n", report.standDownS);
+    }
+  }
+}
+
+int run(int argc, char **argv)
+{
+  parseOptions(argc, argv);
+  rng.seed(options.seed);
+
+  bootMicros = ((1ULL << 32) - (uint64_t)(options.wrapInS * 1000)) * 1000;
+  fake::clock().micros = bootMicros;
+  fake::clock().onAdvance = deliver;
+  fake::onUdpSend = ntpServer;
+
+  every(options.wifiEveryH * 3600, wifiDrop);
+  every(options.buttonEveryS, buttonPress);
+  every(options.httpEveryS, httpRequest);
+  every(options.beaconEveryS, beaconLeader);
+
+  setup();
+  sleep::setPowerMode(options.powerMode);
+  beacon::setEnabled(options.beaconEveryS > 0);
+
+  uint64_t end = bootMicros + (uint64_t)(options.days * 86400e6);
+  while (now() < end) {
+    uint64_t loopStart = now();
+    auto hostStart = std::chrono::steady_clock::now();
+    loop();
+    auto hostNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now() - hostStart)
+                      .count();
+    observe(loopStart, hostNs);
+  }
+
+  print();
+  return 0;
+}
+}  // namespace sim
+
+int main(int argc, char **argv) { return sim::run(argc, argv); }